@@ -0,0 +1,264 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * 测量dwm处理map和ConfigureRequest的延迟。自己启动Xvfb和被测的dwm，不需要桌面环境：
+ *   make bench-configure && ./bench-configure ./dwm 50 200
+ * 比较修改前后时，分别编译两个dwm，依次作为第一个参数运行，比较两次的输出。
+ * dwm使用临时的HOME运行，不会执行用户的autostart，也不会读写用户的~/.cache/dwm。 */
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+
+static pid_t xvfb = -1, wm = -1;
+static char home[] = "/tmp/bench-configure.XXXXXX";
+static int havehome;
+
+static long long
+getus(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static void
+sleepms(long ms)
+{
+  struct timespec ts = { ms / 1000, ms % 1000 * 1000000L };
+
+  nanosleep(&ts, NULL);
+}
+
+static void
+stop(void)
+{
+  char cmd[64];
+
+  if (wm > 0) {
+    kill(wm, SIGTERM);
+    waitpid(wm, NULL, 0);
+    wm = -1;
+  }
+  if (xvfb > 0) {
+    kill(xvfb, SIGTERM);
+    waitpid(xvfb, NULL, 0);
+    xvfb = -1;
+  }
+  if (havehome) {
+    havehome = 0;
+    snprintf(cmd, sizeof cmd, "rm -rf %s", home);
+    if (system(cmd))
+      fprintf(stderr, "bench-configure: cannot remove %s\n", home);
+  }
+}
+
+static void
+timeout(int sig)
+{
+  stop();
+  fputs("bench-configure: timed out, is the dwm alive?\n", stderr);
+  _exit(EXIT_FAILURE);
+}
+
+static pid_t
+start(char *const argv[])
+{
+  pid_t pid;
+
+  if ((pid = fork()) == 0) {
+    execvp(argv[0], argv);
+    fprintf(stderr, "bench-configure: execvp %s failed\n", argv[0]);
+    _exit(127);
+  }
+  return pid;
+}
+
+/* 在空闲的display号上启动Xvfb，返回连接 */
+static Display *
+startxvfb(char *display, size_t size)
+{
+  char *argv[] = { "Xvfb", display, "-screen", "0", "1920x1080x24", "-nolisten", "tcp", NULL };
+  Display *dpy;
+  int n, i, status;
+
+  for (n = 90; n < 100; n++) {
+    snprintf(display, size, ":%d", n);
+    if ((dpy = XOpenDisplay(display))) {
+      XCloseDisplay(dpy);
+      continue; /* 已被占用 */
+    }
+    xvfb = start(argv);
+    for (i = 0; i < 50; i++) {
+      sleepms(100);
+      if (waitpid(xvfb, &status, WNOHANG) == xvfb) {
+        xvfb = -1;
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 127)
+          return NULL; /* 没有安装Xvfb */
+        break; /* 锁文件冲突等，换下一个display号 */
+      }
+      if ((dpy = XOpenDisplay(display)))
+        return dpy;
+    }
+    if (xvfb > 0) {
+      kill(xvfb, SIGTERM);
+      waitpid(xvfb, NULL, 0);
+      xvfb = -1;
+    }
+  }
+  return NULL;
+}
+
+/* 等到dwm设置了root上的_NET_SUPPORTING_WM_CHECK */
+static int
+waitwm(Display *dpy)
+{
+  Atom check = XInternAtom(dpy, "_NET_SUPPORTING_WM_CHECK", False), type;
+  unsigned long nitems, after;
+  unsigned char *p;
+  int format, i;
+
+  for (i = 0; i < 50; i++) {
+    p = NULL;
+    if (XGetWindowProperty(dpy, DefaultRootWindow(dpy), check, 0, 1, False, XA_WINDOW,
+        &type, &format, &nitems, &after, &p) == Success && p) {
+      XFree(p);
+      if (nitems == 1)
+        return 1;
+    }
+    if (waitpid(wm, NULL, WNOHANG) == wm) {
+      wm = -1;
+      return 0;
+    }
+    sleepms(100);
+  }
+  return 0;
+}
+
+/* 等dwm处理完之前的请求（如map之后的arrange），丢弃已经收到的事件 */
+static void
+settle(Display *dpy)
+{
+  sleepms(200);
+  XSync(dpy, True);
+}
+
+/* 等到每个窗口都收到一次type事件，返回耗时(us) */
+static long long
+waitall(Display *dpy, Window *wins, char *seen, int n, int type, long long start)
+{
+  XEvent ev;
+  int i, left = n;
+
+  for (i = 0; i < n; i++)
+    seen[i] = 0;
+  while (left > 0) {
+    XNextEvent(dpy, &ev);
+    if (ev.type != type)
+      continue;
+    for (i = 0; i < n; i++)
+      if (wins[i] == ev.xany.window && !seen[i]) {
+        seen[i] = 1;
+        left--;
+      }
+  }
+  return getus() - start;
+}
+
+static void
+run(Display *dpy, int n)
+{
+  Window root = DefaultRootWindow(dpy), *wins;
+  char *seen;
+  int i, round, rounds = 20;
+  long long t, map, conf = 0, confmax = 0;
+
+  wins = calloc(n, sizeof(Window));
+  seen = calloc(n, 1);
+  for (i = 0; i < n; i++) {
+    wins[i] = XCreateSimpleWindow(dpy, root, 0, 0, 200, 200, 0, 0, 0);
+    XSelectInput(dpy, wins[i], StructureNotifyMask);
+  }
+  XSync(dpy, False);
+  t = getus();
+  for (i = 0; i < n; i++)
+    XMapWindow(dpy, wins[i]);
+  XFlush(dpy);
+  map = waitall(dpy, wins, seen, n, MapNotify, t);
+  settle(dpy);
+  /* 每轮给所有窗口发一次ConfigureRequest，dwm对平铺的窗口回复合成的ConfigureNotify */
+  for (round = 0; round < rounds; round++) {
+    t = getus();
+    for (i = 0; i < n; i++)
+      XMoveResizeWindow(dpy, wins[i], round, round, 200 + round, 200 + round);
+    XFlush(dpy);
+    t = waitall(dpy, wins, seen, n, ConfigureNotify, t);
+    conf += t;
+    if (t > confmax)
+      confmax = t;
+    settle(dpy);
+  }
+  printf("windows %d\n", n);
+  printf("map all          %8lld us\n", map);
+  printf("configure round  %8lld us avg  %8lld us max  (%d rounds)\n", conf / rounds, confmax, rounds);
+  printf("configure each   %8.1f us avg\n", (double)conf / rounds / n);
+  for (i = 0; i < n; i++)
+    XDestroyWindow(dpy, wins[i]);
+  XSync(dpy, False);
+  settle(dpy);
+  free(wins);
+  free(seen);
+}
+
+int
+main(int argc, char *argv[])
+{
+  Display *dpy;
+  char display[16];
+  char *wmargv[] = { argc > 1 ? argv[1] : "./dwm", NULL };
+  int i, n;
+
+  if (argc < 2 || !strcmp(argv[1], "-h")) {
+    fputs("usage: bench-configure dwm [windows...]  (starts Xvfb, default 50 200 windows)\n", stderr);
+    return EXIT_FAILURE;
+  }
+  if (!mkdtemp(home)) {
+    perror("bench-configure: mkdtemp");
+    return EXIT_FAILURE;
+  }
+  havehome = 1;
+  atexit(stop);
+  signal(SIGALRM, timeout);
+  alarm(600);
+  if (!(dpy = startxvfb(display, sizeof display))) {
+    fputs("bench-configure: cannot start Xvfb\n", stderr);
+    return EXIT_FAILURE;
+  }
+  setenv("DISPLAY", display, 1);
+  setenv("HOME", home, 1);
+  unsetenv("XDG_DATA_HOME");
+  unsetenv("XDG_CONFIG_HOME");
+  unsetenv("XDG_CACHE_HOME");
+  wm = start(wmargv);
+  if (!waitwm(dpy)) {
+    fprintf(stderr, "bench-configure: %s did not start on %s\n", wmargv[0], display);
+    return EXIT_FAILURE;
+  }
+  settle(dpy);
+  printf("dwm %s on Xvfb %s\n", wmargv[0], display);
+  if (argc > 2) {
+    for (i = 2; i < argc; i++)
+      if ((n = atoi(argv[i])) > 0)
+        run(dpy, n);
+  } else {
+    run(dpy, 50);
+    run(dpy, 200);
+  }
+  XCloseDisplay(dpy);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,77 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * make bench：比较wintoclient的哈希表查找和原来遍历所有client的线性查找，
+ * 不需要X server。直接包含dwm.c，测量的就是dwm中的wintabget。 */
+#define main dwmmain
+#include "dwm.c"
+#undef main
+
+/* 引入哈希表之前的wintoclient */
+static Client *
+linearclient(Window w)
+{
+  Client *c;
+  Monitor *m;
+
+  for (m = mons; m; m = m->next)
+    for (c = m->clients; c; c = c->next)
+      if (c->win == w)
+        return c;
+  return NULL;
+}
+
+static double
+bench(Client *(*lookup)(Window), Window *wins, unsigned int nwins, unsigned long iters)
+{
+  unsigned long i, found = 0;
+  long long start = getus();
+
+  for (i = 0; i < iters; i++)
+    found += lookup(wins[i % nwins]) != NULL;
+  if (found != iters / 2 && found != iters / 2 + 1)
+    die("bench: %lu of %lu lookups found a client", found, iters);
+  return (getus() - start) * 1000.0 / iters;
+}
+
+int
+main(void)
+{
+  unsigned int sizes[] = { 10, 50, 200, 1000 };
+  unsigned int i, j, n;
+  unsigned long iters;
+  Window *wins;
+  Client *c, *cs;
+
+  printf("%8s %14s %14s\n", "clients", "linear ns/op", "wintab ns/op");
+  for (i = 0; i < LENGTH(sizes); i++) {
+    n = sizes[i];
+    mons = ecalloc(1, sizeof(Monitor));
+    cs = ecalloc(n, sizeof(Client));
+    /* 每个X client的XID基址相差0x200000，和真实的窗口ID分布相近 */
+    for (j = 0; j < n; j++) {
+      c = &cs[j];
+      c->win = 0x1000000 + j * 0x200000 + (j % 7) * 0x21;
+      c->mon = mons;
+      c->next = mons->clients;
+      mons->clients = c;
+      wintabput(c->win, WinClient, c);
+    }
+    /* 一半是命中（如PropertyNotify），一半是未管理的窗口（如override-redirect菜单） */
+    wins = ecalloc(2 * n, sizeof(Window));
+    for (j = 0; j < n; j++) {
+      wins[2 * j] = cs[(j * 7919) % n].win;
+      wins[2 * j + 1] = 0x1000000 + j * 0x200000 + 0x100;
+    }
+    iters = 20000000UL / n * 10;
+    printf("%8u %14.1f %14.1f\n", n,
+      bench(linearclient, wins, 2 * n, iters), bench(wintoclient, wins, 2 * n, iters));
+    free(wins);
+    free(cs);
+    free(mons);
+    mons = NULL;
+    free(wintab);
+    wintab = NULL;
+    wintabsize = wintabused = wintablive = 0;
+  }
+  return EXIT_SUCCESS;
+}
@@ -3,6 +3,11 @@
 /* appearance */
 static const unsigned int borderpx  = 5;        /* border pixel of windows */
 static const unsigned int snap      = 32;       /* snap pixel */
+static const int refreshrate        = 60;       /* move/resize updates per second when XRandR can't tell the monitor's rate */
+static const int outlinemode        = 0;        /* 1: 移动和调整窗口大小时只绘制轮廓，结束后再配置窗口，rules中可以按窗口开启 */
+static const int outlinedelay       = 300;      /* 键盘移动/调整大小停止多少ms后配置窗口 */
+static const int sessiondelay       = 2000;     /* pertag和浮动窗口几何变化后最多每多少ms保存一次~/.cache/dwm/session-$DISPLAY */
+static const int statusdelay        = 200;      /* 聚焦的monitor、窗口和tags停止变化多少ms后写入~/.cache/dwm/status */
 static const unsigned int systraypinning = 0;   /* 0: sloppy systray follows selected monitor, >0: pin systray to monitor X */
 static const unsigned int systrayspacing = 2;   /* systray spacing */
 static const int systraypinningfailfirst = 1;   /* 1: if pinning fails, display systray on the first monitor, False: display systray on the last monitor*/
@@ -126,19 +131,20 @@ static const Rule rules[] = {
    *	WM_CLASS(STRING) = instance, class
    *	WM_NAME(STRING) = title
    */
-  /* class            instance    title    tags mask    isfloating    monitor    hideborder    fixrender    x(float)    y(float)  width(float)    height(float) */
-  { "Peek",           NULL,       NULL,    0,           1,            -1,        0,            0,           0,          0,        -1,             -1      },
-  { "popo",           NULL,       NULL,    0,           1,            -1,        1,            0,           0,          0,        -1,             -1      },
-  { "wechat.exe",     NULL,       NULL,    0,           1,            -1,        0,            0,           0,          0,        -1,             -1      },
-  { "QQ",             NULL,       NULL,    0,           1,            -1,        0,            0,           0,          0,        -1,             -1      },
-  { "feh",            NULL,       NULL,    0,           1,            -1,        0,            0,           0,          0,        -1,             -1      },
-  { "XMind",          NULL,       NULL,    0,           0,            -1,        0,            1,           0,          0,        -1,             -1      },
-  { "xiaoyi_assistant", NULL,     NULL,    1<<8,        0,            -1,        0,            1,           0,          0,        -1,             -1      },
-  { "jetbrains-idea", NULL,       NULL,    0,           0,            -1,        0,            0,           0,          0,        -1,             -1      },
-  { "jetbrains-idea-ce", NULL,    NULL,    0,           0,            -1,        0,            0,           0,          0,        -1,             -1      },
-  { "com-xk72-charles-gui-MainWithClassLoader", NULL, "Find in Session 1", 0, 1, -1, 0,        0,           0,          0,        -1,             -1      },
-  { "netease-cloud-music", NULL,  NULL,    0,           1,            -1,        0,            0,           0,          0,        -1,             -1      },
-  { "Alacritty",      NULL,       "#todolist",  0,      1,            -1,        0,            0,           -1550,      0,        1550,           800     },
+  /* class            instance    title    tags mask    isfloating    monitor    hideborder    fixrender    outline    x(float)    y(float)  width(float)    height(float) */
+  { "Peek",           NULL,       NULL,    0,           1,            -1,        0,            0,            0,          0,          0,        -1,             -1      },
+  { "popo",           NULL,       NULL,    0,           1,            -1,        1,            0,            0,          0,          0,        -1,             -1      },
+  { "wechat.exe",     NULL,       NULL,    0,           1,            -1,        0,            0,            0,          0,          0,        -1,             -1      },
+  { "QQ",             NULL,       NULL,    0,           1,            -1,        0,            0,            0,          0,          0,        -1,             -1      },
+  { "feh",            NULL,       NULL,    0,           1,            -1,        0,            0,            0,          0,          0,        -1,             -1      },
+  { "XMind",          NULL,       NULL,    0,           0,            -1,        0,            1,            0,          0,          0,        -1,             -1      },
+  { "xiaoyi_assistant", NULL,     NULL,    1<<8,        0,            -1,        0,            1,            0,          0,          0,        -1,             -1      },
+  /* outline为1时拖动和调整大小只画轮廓，结束后才配置窗口，重绘很慢的窗口（如下面的jetbrains-idea）可以按需改为1 */
+  { "jetbrains-idea", NULL,       NULL,    0,           0,            -1,        0,            0,            0,          0,          0,        -1,             -1      },
+  { "jetbrains-idea-ce", NULL,    NULL,    0,           0,            -1,        0,            0,            0,          0,          0,        -1,             -1      },
+  { "com-xk72-charles-gui-MainWithClassLoader", NULL, "Find in Session 1", 0, 1, -1, 0,        0,            0,          0,          0,        -1,             -1      },
+  { "netease-cloud-music", NULL,  NULL,    0,           1,            -1,        0,            0,            0,          0,          0,        -1,             -1      },
+  { "Alacritty",      NULL,       "#todolist",  0,      1,            -1,        0,            0,            0,          -1550,      0,        1550,           800     },
 };
 
 // overview
@@ -191,9 +197,6 @@ static const char *flameshotcmd[] = { "flameshot-wrapper.sh", "gui", NULL };
 static const char *flameshotocrcmd[] = { "flameshot-ocr.sh", NULL };
 static const char *monitorswitch1[] = { "monitor-switch.sh", "1", NULL };
 static const char *monitorswitch2[] = { "monitor-switch.sh", "2", NULL };
-static const char *mouseclick1[] = { "xdotool", "click", "1", NULL }; // 鼠标左键点击
-static const char *mouseclick2[] = { "xdotool", "click", "2", NULL }; // 鼠标中键点击
-static const char *mouseclick3[] = { "xdotool", "click", "3", NULL }; // 鼠标右键点击
 
 /* 
  * xev命令可以获取keycode
@@ -267,9 +270,9 @@ static const Key keys[] = {
   { Mod4Mask|ShiftMask,           XK_Right,     resizewin,       {.ui = H_EXPAND} }, // 水平增加窗口大小
 
   /* 鼠标控制 */
-  { MODKEY|ControlMask,              XK_z,         spawn,           {.v = mouseclick1} },  // 鼠标左键点击
-  { MODKEY|ControlMask,              XK_x,         spawn,           {.v = mouseclick2} },  // 鼠标中键点击
-  { MODKEY|ControlMask,              XK_c,         spawn,           {.v = mouseclick3} },  // 鼠标右键点击
+  { MODKEY|ControlMask,              XK_z,         mouseclick,      {.ui = Button1} },     // 鼠标左键点击
+  { MODKEY|ControlMask,              XK_x,         mouseclick,      {.ui = Button2} },     // 鼠标中键点击
+  { MODKEY|ControlMask,              XK_c,         mouseclick,      {.ui = Button3} },     // 鼠标右键点击
   { MODKEY|ControlMask,              XK_f,         mousefocus,      {0} },                 // 鼠标聚焦到当前选中窗口
   { MODKEY|ControlMask,              XK_k,         mousemove,       {.ui = MOUSE_UP} },    // 向上移动鼠标光标
   { MODKEY|ControlMask,              XK_l,         mousemove,       {.ui = MOUSE_RIGHT} }, // 向右移动鼠标光标
@@ -360,11 +363,93 @@ static const Button buttons[] = {
 
 /* signal definitions */
 /* signum must be greater than 0 */
-/* trigger signals using `xsetroot -name "fsignal:<signum>"` */
+/* trigger signals using `dwm-msg signal <signum>` */
 static Signal signals[] = {
   /* signum       function           argument  */
   // {  1,           dumpstatus,     {.v = 0}},
+#ifdef STATS
+  {  96,          dumpstats,         {0}}, // 事件处理耗时统计输出到stderr
+#endif
   {  97,          switchenternotify, {.ui = 1}},
   {  98,          switchenternotify, {.ui = 0}},
   {  99,          quit,              {0}},
 };
+
+/* status modules, rendered after the external status text (fifo, dwm-msg status or xsetroot) */
+/* each module keeps its /proc and /sys files open and only redraws the bar when its text changes */
+static const char statussep[] = " | ";
+/* 网卡或电池不存在时对应的模块输出为空，不占位置；按本机的设备名修改 */
+static const StatusModule statusmodules[] = {
+  /* function     argument           interval(ms) */
+  { stnet,        "wlan0",           2000 },
+  { stcpu,        NULL,              2000 },
+  { stmem,        NULL,              5000 },
+  { stbattery,    "BAT0",            30000 },
+  { stclock,      "%m-%d %a %H:%M",  1000 },
+};
+
+#ifdef STATS
+/* round trips allowed per call of an operation, `dwm-msg stats check` fails when one is exceeded.
+ * 以下数值是按代码路径数出的上限，还没有在真实display上测量过。测量方法：
+ *   1. config.mk中启用STATSFLAGS，编译安装后 dwm-msg restart
+ *   2. dwm-msg stats reset
+ *   3. 运行典型的操作：./bench-configure 50、切换tags、打开关闭常用程序、调整浮动窗口
+ *   4. dwm-msg stats budgets 输出各操作单次的最大round trip数，格式与下表相同，可以直接替换 */
+static const RoundTripBudget rtbudgets[] = {
+  /* operation    round trips */
+  { "view",       3 },  /* focus(NULL) */
+  { "focus",      3 },  /* XGetModifierMapping in grabbuttons for the old and the new client, WM_PROTOCOLS in setfocus */
+  { "manage",     16 }, /* Xlib path: WM_STATE, 2 names, class, transient, 2 atoms, normal hints, wm hints,
+                           protocols + sync counter, 3 grabbuttons, WM_PROTOCOLS in setfocus, keymap if stale */
+  { "arrange",    4 },  /* 1 per client whose WM_NORMAL_HINTS changed since its last arrange */
+  { "restack",    1 },  /* the XSync before dropping EnterNotify */
+  { "drawbar",    0 },  /* Xft measures text on the client side */
+};
+#endif
+
+/* ipc commands, e.g. `dwm-msg view 3`, `dwm-msg setlayout 2` */
+/* argtype: IpcArgNone, IpcArgInt, IpcArgUint, IpcArgFloat, IpcArgTag (1..n, 0 = all tags), IpcArgLayout (index into layouts) */
+static const Command commands[] = {
+  /* name               function           argtype */
+  { "view",             view,              IpcArgTag },
+  { "toggleview",       toggleview,        IpcArgTag },
+  { "tag",              tag,               IpcArgTag },
+  { "toggletag",        toggletag,         IpcArgTag },
+  { "viewtoleft",       viewtoleft,        IpcArgNone },
+  { "viewtoright",      viewtoright,       IpcArgNone },
+  { "setlayout",        setlayout,         IpcArgLayout },
+  { "setmfact",         setmfact,          IpcArgFloat },
+  { "incnmaster",       incnmaster,        IpcArgInt },
+  { "focusstack",       focusstack,        IpcArgInt },
+  { "focusmon",         focusmon,          IpcArgInt },
+  { "tagmon",           tagmon,            IpcArgInt },
+  { "zoom",             zoom,              IpcArgNone },
+  { "killclient",       killclient,        IpcArgNone },
+  { "togglefloating",   togglefloating,    IpcArgNone },
+  { "fullscreen",       fullscreen,        IpcArgNone },
+  { "togglebar",        togglebar,         IpcArgNone },
+  { "toggleoverview",   toggleoverview,    IpcArgNone },
+  { "togglegaps",       togglegaps,        IpcArgNone },
+  { "incrgaps",         incrgaps,          IpcArgInt },
+  { "switchenternotify",switchenternotify, IpcArgUint },
+  { "quit",             quit,              IpcArgNone },
+  { "restart",          restart,           IpcArgNone },
+  { "reload",           reload,            IpcArgNone },
+  /* 以下主要供运行时配置的key使用，参数为数字形式的枚举值，如movewin 0即WIN_UP */
+  { "togglewin",        togglewin,         IpcArgNone },
+  { "togglefloatingattach", togglefloatingattach, IpcArgNone },
+  { "switchprevclient", switchprevclient,  IpcArgUint },
+  { "movewin",          movewin,           IpcArgUint },
+  { "resizewin",        resizewin,         IpcArgUint },
+  { "mousemove",        mousemove,         IpcArgUint },
+  { "mouseclick",       mouseclick,        IpcArgUint },
+  { "mousefocus",       mousefocus,        IpcArgNone },
+  { "togglesmartgaps",  togglesmartgaps,   IpcArgNone },
+  { "defaultgaps",      defaultgaps,       IpcArgNone },
+  { "incrigaps",        incrigaps,         IpcArgInt },
+  { "incrogaps",        incrogaps,         IpcArgInt },
+  { "incrihgaps",       incrihgaps,        IpcArgInt },
+  { "incrivgaps",       incrivgaps,        IpcArgInt },
+  { "incrohgaps",       incrohgaps,        IpcArgInt },
+  { "incrovgaps",       incrovgaps,        IpcArgInt },
+};
@@ -14,6 +14,25 @@ X11LIB = /usr/X11R6/lib
 XINERAMALIBS  = -lXinerama
 XINERAMAFLAGS = -DXINERAMA
 
+# XRandR, for pacing mouse move/resize to the monitor refresh rate (refreshrate in config.h without it), uncomment to enable
+#XRANDRLIBS  = -lXrandr
+#XRANDRFLAGS = -DXRANDR
+
+# XSync extension, for _NET_WM_SYNC_REQUEST paced resizing, uncomment to enable
+#XSYNCLIBS  = -lXext
+#XSYNCFLAGS = -DXSYNC
+
+# XTest extension, for mouseclick without forking xdotool, comment if you don't want it
+XTESTLIBS  = -lXtst
+XTESTFLAGS = -DXTEST
+
+# XCB, pipelines the property fetches of manage() and scan() into one round trip, comment if you don't want it
+XCBLIBS  = -lX11-xcb -lxcb
+XCBFLAGS = -DXCB
+
+# event loop latency statistics (dwm-msg stats), uncomment to enable
+#STATSFLAGS = -DSTATS
+
 # freetype
 FREETYPELIBS = -lfontconfig -lXft
 FREETYPEINC = /usr/include/freetype2
@@ -23,10 +42,10 @@ FREETYPEINC = /usr/include/freetype2
 
 # includes and libs
 INCS = -I${X11INC} -I${FREETYPEINC}
-LIBS = -L${X11LIB} -lX11 ${XINERAMALIBS} ${FREETYPELIBS} -lXrender
+LIBS = -L${X11LIB} -lX11 ${XINERAMALIBS} ${XRANDRLIBS} ${XSYNCLIBS} ${XTESTLIBS} ${XCBLIBS} ${FREETYPELIBS} -lXrender
 
 # flags
-CPPFLAGS = -D_DEFAULT_SOURCE -D_BSD_SOURCE -D_POSIX_C_SOURCE=200809L -DVERSION=\"${VERSION}\" ${XINERAMAFLAGS}
+CPPFLAGS = -D_DEFAULT_SOURCE -D_BSD_SOURCE -D_POSIX_C_SOURCE=200809L -DVERSION=\"${VERSION}\" ${XINERAMAFLAGS} ${XRANDRFLAGS} ${XSYNCFLAGS} ${XTESTFLAGS} ${XCBFLAGS} ${STATSFLAGS}
 #CFLAGS   = -g -std=c99 -pedantic -Wall -O0 ${INCS} ${CPPFLAGS}
 CFLAGS   = -std=c99 -pedantic -Wall -Wno-deprecated-declarations -Os ${INCS} ${CPPFLAGS}
 LDFLAGS  = ${LIBS}
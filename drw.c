@@ -6,6 +6,7 @@
 #include <X11/Xft/Xft.h>
 
 #include "drw.h"
+#include "stats.h"
 #include "util.h"
 
 #define UTF_INVALID 0xFFFD
@@ -393,7 +394,6 @@ drw_map(Drw *drw, Window win, int x, int y, unsigned int w, unsigned int h)
 		return;
 
 	XCopyArea(drw->dpy, drw->drawable, win, drw->gc, x, y, w, h, x, y);
-	XSync(drw->dpy, False);
 }
 
 unsigned int
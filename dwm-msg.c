@@ -0,0 +1,71 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * dwm-msg sends one command to the control socket of a running dwm and
+ * prints the reply, e.g. `dwm-msg view 3` or `dwm-msg signal 99`.
+ * `dwm-msg subscribe` prints one line per event until dwm goes away.
+ * The socket is $DWM_SOCKET, or $XDG_RUNTIME_DIR/dwm-$DISPLAY.sock.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "util.h"
+
+int
+main(int argc, char *argv[])
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	const char *dir, *display, *sock;
+	char line[512], reply[512], *p;
+	size_t len = 0;
+	ssize_t n;
+	int fd, i;
+
+	if (argc < 2)
+		die("usage: dwm-msg command [argument]");
+	if ((sock = getenv("DWM_SOCKET")) && *sock)
+		snprintf(addr.sun_path, sizeof addr.sun_path, "%s", sock);
+	else {
+		if (!(dir = getenv("XDG_RUNTIME_DIR")) || !*dir)
+			dir = "/tmp";
+		if (!(display = getenv("DISPLAY")))
+			display = "";
+		snprintf(addr.sun_path, sizeof addr.sun_path, "%s/dwm-%s.sock", dir, display);
+		for (p = addr.sun_path + strlen(dir) + 1; *p; p++)
+			if (*p == '/')
+				*p = '_';
+	}
+	for (i = 1; i < argc; i++) {
+		n = snprintf(line + len, sizeof line - len, "%s%s", i > 1 ? " " : "", argv[i]);
+		if (n < 0 || (size_t)n >= sizeof line - len - 1)
+			die("dwm-msg: command too long");
+		len += n;
+	}
+	line[len++] = '\n';
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+		die("dwm-msg: socket:");
+	if (connect(fd, (struct sockaddr *)&addr, sizeof addr) < 0)
+		die("dwm-msg: connect '%s':", addr.sun_path);
+	if (write(fd, line, len) != (ssize_t)len)
+		die("dwm-msg: write:");
+	if (!strcmp(argv[1], "subscribe")) {
+		while ((n = read(fd, reply, sizeof reply)) > 0)
+			if (fwrite(reply, 1, n, stdout) != (size_t)n || fflush(stdout))
+				return 1;
+		return 0;
+	}
+	shutdown(fd, SHUT_WR);
+
+	len = 0;
+	while (len < sizeof reply - 1 && (n = read(fd, reply + len, sizeof reply - 1 - len)) > 0)
+		len += n;
+	close(fd);
+	reply[len] = '\0';
+	fputs(reply, stdout);
+	return strncmp(reply, "ok", 2) != 0;
+}
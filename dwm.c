@@ -22,18 +22,28 @@
  */
 #include <ctype.h> /* for making tab label lowercase, very tiny standard library */
 #include <errno.h>
+#include <fcntl.h>
 #include <locale.h>
+#include <poll.h>
 #include <signal.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/un.h>
 #include <sys/wait.h>
 #include <X11/cursorfont.h>
 #include <X11/keysym.h>
+#include <X11/XKBlib.h>
 #include <X11/Xatom.h>
 #include <X11/Xlib.h>
 #include <X11/Xproto.h>
@@ -41,11 +51,24 @@
 #ifdef XINERAMA
 #include <X11/extensions/Xinerama.h>
 #endif /* XINERAMA */
+#ifdef XRANDR
+#include <X11/extensions/Xrandr.h>
+#endif /* XRANDR */
+#ifdef XSYNC
+#include <X11/extensions/sync.h>
+#endif /* XSYNC */
+#ifdef XTEST
+#include <X11/extensions/XTest.h>
+#endif /* XTEST */
+#ifdef XCB
+#include <X11/Xlib-xcb.h>
+#include <xcb/xcb.h>
+#endif /* XCB */
 #include <X11/Xft/Xft.h>
-#include <sys/time.h>
 #include <math.h>
 
 #include "drw.h"
+#include "stats.h"
 #include "util.h"
 
 /* macros */
@@ -54,7 +77,11 @@
 #define INTERSECT(x,y,w,h,m)    (MAX(0, MIN((x)+(w),(m)->wx+(m)->ww) - MAX((x),(m)->wx)) \
                                * MAX(0, MIN((y)+(h),(m)->wy+(m)->wh) - MAX((y),(m)->wy)))
 #define ISVISIBLE(C)            ((C->mon->isoverview || C->tags & C->mon->tagset[C->mon->seltags]))
-#define HIDDEN(C)               ((getstate(C->win) == IconicState))
+#define HIDDEN(C)               ((C)->state == IconicState)
+/* _DWM_STATE的版本和每条记录的长度(long) */
+#define STATEVERSION            1
+#define MONSTATE                (5 + 6 * (LENGTH(tags) + 1))
+#define CLIENTSTATE             8
 #define LENGTH(X)               (sizeof X / sizeof X[0])
 #define MOUSEMASK               (BUTTONMASK|PointerMotionMask)
 #define WIDTH(X)                ((X)->w + 2 * (X)->bw)
@@ -87,15 +114,18 @@ enum { SchemeNorm, SchemeSel, SchemeHid }; /* color schemes */
 enum { NetSupported, NetWMName, NetWMState, NetWMCheck,
        NetSystemTray, NetSystemTrayOP, NetSystemTrayOrientation, NetSystemTrayOrientationHorz,
        NetWMFullscreen, NetActiveWindow, NetWMWindowType,
-       NetWMWindowTypeDialog, NetClientList, NetLast }; /* EWMH atoms */
+       NetWMWindowTypeDialog, NetClientList, NetWMSyncRequest, NetWMSyncRequestCounter, NetLast }; /* EWMH atoms */
 enum { Manager, Xembed, XembedInfo, XLast }; /* Xembed atoms */
-enum { WMProtocols, WMDelete, WMState, WMTakeFocus, WMLast }; /* default atoms */
+enum { WMProtocols, WMDelete, WMState, WMTakeFocus, DWMState, WMLast }; /* default atoms */
 enum { ClkTagBar, ClkLtSymbol, ClkStatusText, ClkWinTitle,
        ClkClientWin, ClkRootWin, ClkLast }; /* clicks */
 enum { WIN_UP, WIN_DOWN, WIN_LEFT, WIN_RIGHT }; /* movewin */
 enum { V_EXPAND, V_REDUCE, H_EXPAND, H_REDUCE }; /* resizewins */
 enum { MOUSE_UP, MOUSE_RIGHT, MOUSE_DOWM, MOUSE_LEFT }; /* movemouse */
 enum { SWITCH_WIN,  SWITCH_SAME_TAG,  SWITCH_DIFF_TAG,  SWITCH_SMART }; /* switch mode */
+enum { DirtyLayout = 1 << 0, DirtyStack = 1 << 1, DirtyBar = 1 << 2, DirtyStatus = 1 << 3 }; /* monitor dirty bits */
+enum { WinFree, WinDeleted, WinClient, WinSystrayIcon, WinBar }; /* window table entry types */
+enum { IpcArgNone, IpcArgInt, IpcArgUint, IpcArgFloat, IpcArgTag, IpcArgLayout }; /* ipc argument types */
 
 typedef union {
   int i;
@@ -110,6 +140,60 @@ typedef struct {
 	const Arg arg;
 } Signal;
 
+typedef struct {
+  int fd[2];                /* 保持打开的/proc、/sys文件，用pread重复读取 */
+  unsigned long long a, b;  /* 上次采样的计数，用于计算cpu使用率、网速 */
+  long long last;           /* 上次采样的时间(ms) */
+  long long next;           /* 下次更新的时间(ms) */
+  char text[64];
+} StatusState;
+
+typedef struct {
+  void (*func)(StatusState *st, const char *arg, char *buf, size_t size);
+  const char *arg;
+  int interval; /* ms */
+} StatusModule;
+
+#ifdef STATS
+enum { StatArrange, StatRestack, StatDrawbar, StatWatch, StatLast }; /* 事件之外单独统计的操作 */
+enum { ReqView, ReqFocus, ReqManage, ReqArrange, ReqRestack, ReqDrawbar, ReqLast }; /* 统计X请求数的操作 */
+
+typedef struct {
+  unsigned long count;
+  unsigned long long total;  /* us */
+  unsigned long max;         /* us */
+  Window maxwin;             /* 耗时最长的一次所处理的窗口 */
+  unsigned long hist[24];    /* hist[i]: 耗时在[2^i, 2^(i+1)) us之间的次数 */
+} Stat;
+
+typedef struct {
+  unsigned long count;
+  unsigned long long requests, roundtrips, flushes;
+  unsigned long maxrequests, maxroundtrips; /* 单次操作的最大值 */
+} ReqStat;
+
+typedef struct {
+  unsigned long request, roundtrips, flushes;
+} ReqMark;
+
+typedef struct {
+  const char *op;
+  unsigned long roundtrips; /* 单次操作允许的最大round trip数 */
+} RoundTripBudget;
+
+#define REQBEGIN ReqMark reqmark; reqbegin(&reqmark)
+#define REQEND(op) reqend(op, &reqmark)
+#else
+#define REQBEGIN
+#define REQEND(op)
+#endif
+
+typedef struct {
+  const char *name;
+  void (*func)(const Arg *);
+  int argtype;
+} Command;
+
 typedef struct {
   unsigned int click;
   unsigned int mask;
@@ -118,6 +202,10 @@ typedef struct {
   const Arg arg;
 } Button;
 
+typedef struct {
+  int x, y, w, h, bw;
+} Geom;
+
 typedef struct Monitor Monitor;
 typedef struct Client Client;
 struct Client {
@@ -134,7 +222,26 @@ struct Client {
   Monitor *mon;
   Window win;
   int fixrender;
+  int outline;     /* 移动和调整大小时只绘制轮廓 */
   int hid;
+  long state;      /* WM_STATE缓存，由setclientstate和PropertyNotify维护 */
+  Atom wintype;    /* _NET_WM_WINDOW_TYPE缓存 */
+  XWMHints wmh;    /* WM_HINTS缓存 */
+  int haswmh;
+  const char *class, *instance; /* 驻留的WM_CLASS，manage时获取一次 */
+  const char *icon; /* 标签上展示的名称，由tagnamemap解析 */
+  Geom want;       /* 待提交的窗口几何，由resizeclient和showhide设置 */
+  Geom have;       /* 已经提交给X server的窗口几何 */
+  int configpending; /* 提交时需要发送合成的ConfigureNotify */
+  int fixpending;  /* fixrender偏移后等待恢复的几何 */
+  int fixx, fixy, fixw, fixh;
+  unsigned long borderpixel; /* 已经设置的边框颜色 */
+#ifdef XSYNC
+  XSyncCounter synccounter; /* _NET_WM_SYNC_REQUEST_COUNTER，None表示不支持 */
+  unsigned long long syncvalue;
+  int syncwaiting;          /* 已发送sync request，等待client重绘完成 */
+  long long synctime;       /* 发送sync request的时间(ms) */
+#endif
 };
 
 typedef struct {
@@ -151,6 +258,7 @@ typedef struct {
 } Layout;
 
 typedef struct Pertag Pertag;
+typedef struct Session Session;
 typedef struct ClientAccNode ClientAccNode;
 struct Monitor {
   char ltsymbol[16];
@@ -180,6 +288,11 @@ struct Monitor {
   Pertag *pertag;
   int isoverview; // 是否为预览模式
   ClientAccNode *accstack;
+  unsigned int dirty; // 待在本批事件处理完后统一执行的arrange/restack/drawbar
+  int refresh;        // 刷新率(Hz)，决定鼠标移动、调整窗口大小的更新频率
+  Window evsel;       // 最近一次通知订阅者的聚焦窗口、tags和布局
+  unsigned int evtags;
+  const Layout *evlt;
 };
 
 typedef struct {
@@ -191,12 +304,21 @@ typedef struct {
   int monitor;
   int hideborder;
   int fixrender;
+  int outline;
   int x;
   int y;
   int width;
   int height;
 } Rule;
 
+#ifdef XCB
+typedef struct {
+  Window win;                          /* 正在manage的窗口，None表示没有预取 */
+  Atom atoms[11];
+  xcb_get_property_reply_t *props[11]; /* NULL表示属性不存在 */
+} Prefetch;
+#endif
+
 typedef struct Systray Systray;
 struct Systray {
   Window win;
@@ -213,6 +335,33 @@ struct ClientAccNode {
   ClientAccNode *next;
 };
 
+typedef struct {
+  Window win;
+  int type;
+  void *p; /* Client或Monitor */
+} WinEntry;
+
+typedef struct {
+  long long when; /* 到期时间(ms)，0表示空闲槽位 */
+  void (*func)(void *arg);
+  void *arg;
+} Timer;
+
+typedef struct {
+  int fd;
+  int subscribed;
+  size_t len;
+  char buf[512];  /* 尚未读到换行的命令 */
+  size_t outlen;
+  char out[8192]; /* 尚未写出的回复和事件，写满时断开该连接 */
+} IpcConn;
+
+typedef struct InternStr InternStr;
+struct InternStr {
+  InternStr *next;
+  char s[];
+};
+
 /* function declarations */
 static void applyrules(Client *c);
 static int applysizehints(Client *c, int *x, int *y, int *w, int *h, int interact);
@@ -225,7 +374,12 @@ static int isappend(Client *c);
 static void buttonpress(XEvent *e);
 static void checkotherwm(void);
 static void cleanup(void);
+static void cleanupipc(void);
+static void cleanupstatusmodules(void);
+static void composestatus(void);
 static void cleanupmon(Monitor *mon);
+static void commitgeom(Client *c);
+static void commitgeoms(void);
 static void clientmessage(XEvent *e);
 static void configure(Client *c);
 static void configurenotify(XEvent *e);
@@ -237,29 +391,61 @@ static void detach(Client *c);
 static void detachstack(Client *c);
 static Monitor *dirtomon(int dir);
 static void drawbar(Monitor *m);
+static void deltimers(void *arg);
+static Bool dragevent(Display *d, XEvent *ev, XPointer arg);
 static void drawbars(void);
+static void drawstatus(Monitor *m);
+static void drawoutline(Client *c);
+#ifdef STATS
+static void dumpstats(const Arg *arg);
+static size_t formatstats(char *buf, size_t size);
+static void statrecord(Stat *st, long long start, Window w);
+static void reqbegin(ReqMark *mark);
+static void reqend(int op, ReqMark *mark);
+static size_t checkbudgets(char *buf, size_t size);
+static size_t formatbudgets(char *buf, size_t size);
+#endif
 static void enternotify(XEvent *e);
 static void expose(XEvent *e);
 static void focus(Client *c);
 static void focusin(XEvent *e);
 static void focusmon(const Arg *arg);
 static void focusmonbyclient(Client *c);
+static void fixrender(void *arg);
 static void focusstack(const Arg *arg);
 static void focusclient(const Arg *arg);
+static void flushdirty(void);
 static Atom getatomprop(Client *c, Atom prop);
+static long long getms(void);
+static long long getus(void);
 static int getrootptr(int *x, int *y);
 static long getstate(Window w);
+static int gettransient(Window w, Window *trans);
 static unsigned int getsystraywidth();
 static int gettextprop(Window w, Atom atom, char *text, unsigned int size);
 static void grabbuttons(Client *c, int focused);
 static void grabkeys(void);
 static void hide(const Arg *arg);
+static void hideoutline(void);
 static void hidewin(Client *c);
 static void incnmaster(const Arg *arg);
+static const char *intern(const char *s);
+static void ipcaccept(int fd, short revents);
+static void ipcclose(IpcConn *conn);
+static void ipcevent(const char *fmt, ...);
+static void ipcexec(IpcConn *conn, char *line);
+static void ipcflush(IpcConn *conn);
+static void ipchandle(int fd, short revents);
+static void ipcqueue(IpcConn *conn, const char *s, size_t n);
+static void ipcreply(IpcConn *conn, const char *fmt, ...);
+static void ipcsnapshot(IpcConn *conn);
+static int keyrepeats(XKeyEvent *ev);
 static void keypress(XEvent *e);
-static int fake_signal(void);
+static void keyrelease(XEvent *e);
 static void killclient(const Arg *arg);
 static void manage(Window w, XWindowAttributes *wa);
+static void markdirty(Monitor *m, unsigned int bits);
+static unsigned int matchrules(Client *c);
 static void mappingnotify(XEvent *e);
 static void maprequest(XEvent *e);
 static void monocle(Monitor *m);
@@ -267,9 +453,33 @@ static void monoclehid(Monitor *m);
 static void motionnotify(XEvent *e);
 static void movemouse(const Arg *arg);
 static Client *nexttiled(Client *c);
+static int outlinebegin(Client *c);
+static void outlineend(void *arg);
 static void pop(Client *c);
+#ifdef XCB
+static int prefetched(Window w, Atom atom, xcb_get_property_reply_t **r);
+static void prefetchfree(void);
+static void prefetchprops(Window w);
+#endif
 static void propertynotify(XEvent *e);
+static void publishevents(void);
+static void publishstatus(void);
 static void quit(const Arg *arg);
+static void loadstate(void);
+static void restart(const Arg *arg);
+static int restoreclient(Client *c);
+static void savestate(void);
+static void configwatch(int fd, short revents);
+static void loadconfig(void *arg);
+static const char *parsecmdarg(int argtype, const char *val, Arg *arg);
+static int parsemods(char *s);
+static char *parsetoken(char **s);
+static void readconfig(void);
+static void reload(const Arg *arg);
+static void setupconfig(void);
+static int sockinuse(const char *path);
+static int fifoinuse(const char *path);
+static void lastmotion(XEvent *ev);
 static Monitor *recttomon(int x, int y, int w, int h);
 static void removesystrayicon(Client *i);
 static void resize(Client *c, int x, int y, int w, int h, int interact);
@@ -278,11 +488,15 @@ static void resizeclient(Client *c, int x, int y, int w, int h);
 static void resizemouse(const Arg *arg);
 static void resizerequest(XEvent *e);
 static void restack(Monitor *m);
+static void restackmon(Monitor *m);
 static void run(void);
+static int runtimers(void);
 static void runautosh(const char autoblocksh[], const char autosh[]);
 static void scan(void);
+static void scanwindows(Window *wins, unsigned int num, XWindowAttributes *wa, char *kind);
 static int sendevent(Window w, Atom proto, int m, long d0, long d1, long d2, long d3, long d4);
 static void sendmon(Client *c, Monitor *m);
+static void setborderpixel(Client *c, unsigned long pixel);
 static void setclientstate(Client *c, long state);
 static void setfocus(Client *c);
 static void setfullscreen(Client *c, int fullscreen);
@@ -301,14 +515,37 @@ static void togglesmartgaps(const Arg *arg);
 static void togglegaps(const Arg *arg);
 static void defaultgaps(const Arg *arg);
 static void setlayout(const Arg *arg);
+static void settimer(int ms, void (*func)(void *), void *arg);
 static void setmfact(const Arg *arg);
+static void setstatus(const char *text);
 static void setup(void);
+static void startphase(const char *name);
+static void startreport(void);
+static void setupipc(void);
+static void setupstatusfifo(void);
+static void setupstatusdir(void);
+static void setupsession(void);
+static void savesession(void *arg);
+static void savestatus(void *arg);
+static void marksession(void);
+static void placeclient(Client *c);
+static void applypertag(Monitor *m);
+static unsigned int sessionsum(const Session *ss);
 static void seturgent(Client *c, int urg);
 static void show(const Arg *arg);
 static void showall(const Arg *arg);
 static void showwin(Client *c, int clearflag);
 static void showhide(Client *c);
 static void sigchld(int unused);
+static void statusread(int fd, short revents);
+static void statustimer(int fd, short revents);
+static void setupstatusmodules(void);
+static void stbattery(StatusState *st, const char *arg, char *buf, size_t size);
+static void stclock(StatusState *st, const char *arg, char *buf, size_t size);
+static void stcpu(StatusState *st, const char *arg, char *buf, size_t size);
+static void stmem(StatusState *st, const char *arg, char *buf, size_t size);
+static void stnet(StatusState *st, const char *arg, char *buf, size_t size);
+static ssize_t stread(StatusState *st, int i, const char *path, char *buf, size_t size);
 static int solitary(Client *c);
 static void spawn(const Arg *arg);
 static Monitor *systraytomon(Monitor *m);
@@ -330,17 +567,31 @@ static void unmanage(Client *c, int destroyed);
 static void unmapnotify(XEvent *e);
 static void updatebarpos(Monitor *m);
 static void updatebars(void);
+static void updateclass(Client *c);
 static void updateclientlist(void);
 static int updategeom(void);
 static void updatenumlockmask(void);
+#ifdef XSYNC
+static void syncbegin(Client *c);
+static int syncblocked(Client *c);
+static void syncend(void);
+static void syncrequest(Client *c);
+static void updatesynccounter(Client *c);
+#endif
+static void updaterefresh(void);
 static void updatesizehints(Client *c);
 static void updatestatus(void);
+static void updatetaglabels(Monitor *m);
 static void updatesystray(void);
 static void updatesystrayicongeom(Client *i, int w, int h);
 static void updatesystrayiconstate(Client *i, XPropertyEvent *ev);
 static void updatetitle(Client *c);
 static void updatewindowtype(Client *c);
 static void updatewmhints(Client *c);
+static int watchfd(int fd, short events, void (*func)(int, short));
+static void watchevents(int fd, short events);
+static void unwatchfd(int fd);
+static void writestatus(const char *name, const char *fmt, ...);
 static void viewtoleft(const Arg *arg);
 static void viewtoright(const Arg *arg);
 static void view(const Arg *arg);
@@ -356,6 +607,9 @@ static void addaccstack(Client *c);
 static void removeaccstack(Client *c);
 static void switchenternotify(const Arg *arg);
 static Client *wintoclient(Window w);
+static WinEntry *wintabget(Window w);
+static void wintabput(Window w, int type, void *p);
+static void wintabdel(Window w);
 static Monitor *wintomon(Window w);
 static Client *wintosystrayicon(Window w);
 static int xerror(Display *dpy, XErrorEvent *ee);
@@ -365,10 +619,13 @@ static void xinitvisual();
 static void zoom(const Arg *arg);
 static int inarea(int x, int y, int rx, int ry, int rw, int rh);
 static void movewin(const Arg *arg);
+static void movewinstep(Client *c, unsigned int dir);
 static void resizewin(const Arg *arg);
 static void mousefocus(const Arg *arg);
 static void mousemove(const Arg *arg);
-static const char* gettagdisplayname(Client* c);
+static void mousetick(void *arg);
+static void mouseclick(const Arg *arg);
+static const char *gettagdisplayname(const char *class);
 
 /* variables */
 static Systray *systray =  NULL;
@@ -380,14 +637,32 @@ static const char autostopsh[] = "autostop.sh"; // 这个脚本会以非阻塞
 static const char dwmdir[] = "dwm"; // 自启动脚本的dir名称
 static const char localshare[] = ".local/share"; // 自启动脚本的相对路径
 static char stext[256];
+static char exttext[256];    /* 外部通过FIFO、socket或WM_NAME设置的状态文本 */
+static int statusfd = -1;    /* 状态栏文本的FIFO，每行一次更新 */
+static int statustimerfd = -1; /* 驱动statusmodules的timerfd */
+static char statuspath[sizeof(((struct sockaddr_un *)0)->sun_path)];
+static char statusdir[512]; /* ~/.cache/dwm/status，供外部脚本读取dwm状态 */
+static struct {
+  int selmon;
+  Window selwin;
+  unsigned int seltags;
+} published = { -1, 0, 0 };  /* 最近一次写入statusdir的状态 */
 static int screen;
 static int sw, sh;           /* X display screen geometry width, height */
 static int bh;               /* bar height */
 static int lrpad;            /* sum of left and right padding for text */
 static int smartgaps  = 1;   /* 1 means no outer gap when there is only one window */
 static int enablegaps = 1;   /* enables gaps, used by togglegaps */
-static long long beginmousemove = 0; // 开始movemouse的时间戳
-static long long prevmousemove = 0; // 前一次movemouse的时间戳
+static unsigned int mousedirs; /* 按住的mousemove方向，第MOUSE_UP等位 */
+static KeyCode mousekeys[4];  /* 各方向对应的按键，松开时停止该方向 */
+static long long mousestart, mouselast; /* 开始按住和上一次积分的时间(ms) */
+static double mousefx, mousefy; /* 不足1px的位移，留到下一帧 */
+static const int mousedx[] = { 0, 1, 0, -1 }, mousedy[] = { -1, 0, 1, 0 };
+static KeyCode curkeycode;   /* 正在处理的KeyPress，不是由按键触发时为0 */
+static int keyrepeat = 1;    /* 本次按键合并的自动重复次数，movewin和resizewin按次数累加 */
+#ifdef XTEST
+static int xtest;            /* X server支持XTest，mouseclick不再fork xdotool */
+#endif
 static int (*xerrorxlib)(Display *, XErrorEvent *);
 static unsigned int numlockmask = 0;
 static void (*handler[LASTEvent]) (XEvent *) = {
@@ -400,6 +675,7 @@ static void (*handler[LASTEvent]) (XEvent *) = {
   [Expose] = expose,
   [FocusIn] = focusin,
   [KeyPress] = keypress,
+  [KeyRelease] = keyrelease,
   [MappingNotify] = mappingnotify,
   [MapRequest] = maprequest,
   [MotionNotify] = motionnotify,
@@ -409,6 +685,10 @@ static void (*handler[LASTEvent]) (XEvent *) = {
 };
 static Atom wmatom[WMLast], netatom[NetLast], xatom[XLast];
 static int running = 1;
+static int restarting = 0;   /* run结束后保存状态并exec自身 */
+static long *restorestate;   /* 重启前保存的_DWM_STATE，scan之后释放 */
+static long *restoreclients; /* 其中的client记录，由restoreclient使用 */
+static unsigned long nrestoreclients;
 static Cur *cursor[CurLast];
 static Clr **scheme;
 static Display *dpy;
@@ -420,12 +700,77 @@ static int useargb = 0;
 static Visual *visual;
 static int depth;
 static Colormap cmap;
+static InternStr *interntab[256];
+static WinEntry *wintab;     /* Window到Client/Monitor的开放寻址哈希表 */
+static unsigned int wintabsize, wintabused, wintablive;
+static struct pollfd watchfds[64]; /* 主循环中与X连接一起poll的fd，fd为-1的槽位空闲 */
+static void (*watchfuncs[LENGTH(watchfds)])(int fd, short revents);
+static int nwatchfds;
+static Timer timers[32];     /* 主循环通过poll的超时驱动的定时器 */
+static IpcConn ipcconns[16];
+static int ipcfd = -1;
+static int nsubscribers;
+static int evselmon = -1;
+static char ipcpath[sizeof(((struct sockaddr_un *)0)->sun_path)];
 
 static int enableenternotify = 1;
+static int clientlistdirty = 0;
+static struct {
+  const char *name;
+  long long us;
+} startphases[16];           /* 启动各阶段的耗时，scan之后由startreport输出 */
+static unsigned int nstartphases;
+static long long startmark;
+#ifdef XCB
+static xcb_connection_t *xcb;
+static Prefetch prefetch;    /* manage期间当前窗口一次取回的属性 */
+#endif
+static int bulk = 0;         /* scan和cleanup中批量manage/unmanage，focus和同步留给调用者一次完成 */
+static int geomdirty = 0;    /* 有client的want与have不同，等待commitgeoms */
+static Client *dragclient;   /* 正在被movemouse拖动的client，移动时不发送合成的ConfigureNotify */
+static Client *outlineclient; /* 以轮廓模式移动/调整中的client，几何在outlineend时才提交 */
+static Window outlinewins[4];
+static Geom outlinegeom;     /* 轮廓当前绘制的几何，w为0表示未显示 */
+#ifdef XSYNC
+static int syncevbase = -1;  /* XSync扩展的事件基址，-1表示不可用 */
+static Client *syncclient;   /* 正在被resizemouse调整大小且支持_NET_WM_SYNC_REQUEST的client */
+static XSyncAlarm syncalarm = None;
+#endif
+#ifdef STATS
+static Stat evstats[LASTEvent];
+static Stat opstats[StatLast];
+static ReqStat reqstats[ReqLast];
+static long long statsince;
+unsigned long xroundtrips, xflushes; /* 见stats.h */
+int xkeymapstale = 1;
+static const char *evnames[LASTEvent] = {
+  [KeyPress] = "KeyPress", [KeyRelease] = "KeyRelease", [ButtonPress] = "ButtonPress",
+  [ButtonRelease] = "ButtonRelease", [MotionNotify] = "MotionNotify", [EnterNotify] = "EnterNotify",
+  [LeaveNotify] = "LeaveNotify", [FocusIn] = "FocusIn", [FocusOut] = "FocusOut",
+  [KeymapNotify] = "KeymapNotify", [Expose] = "Expose", [GraphicsExpose] = "GraphicsExpose",
+  [NoExpose] = "NoExpose", [VisibilityNotify] = "VisibilityNotify", [CreateNotify] = "CreateNotify",
+  [DestroyNotify] = "DestroyNotify", [UnmapNotify] = "UnmapNotify", [MapNotify] = "MapNotify",
+  [MapRequest] = "MapRequest", [ReparentNotify] = "ReparentNotify", [ConfigureNotify] = "ConfigureNotify",
+  [ConfigureRequest] = "ConfigureRequest", [GravityNotify] = "GravityNotify", [ResizeRequest] = "ResizeRequest",
+  [CirculateNotify] = "CirculateNotify", [CirculateRequest] = "CirculateRequest", [PropertyNotify] = "PropertyNotify",
+  [SelectionClear] = "SelectionClear", [SelectionRequest] = "SelectionRequest", [SelectionNotify] = "SelectionNotify",
+  [ColormapNotify] = "ColormapNotify", [ClientMessage] = "ClientMessage", [MappingNotify] = "MappingNotify",
+  [GenericEvent] = "GenericEvent",
+};
+static const char *opnames[StatLast] = {
+  [StatArrange] = "arrange", [StatRestack] = "restack", [StatDrawbar] = "drawbar", [StatWatch] = "watch",
+};
+static const char *reqnames[ReqLast] = {
+  [ReqView] = "view", [ReqFocus] = "focus", [ReqManage] = "manage",
+  [ReqArrange] = "arrange", [ReqRestack] = "restack", [ReqDrawbar] = "drawbar",
+};
+#endif
 
 /* configuration, allows nested code to access above variables */
 #include "config.h"
 
+static StatusState statusstates[LENGTH(statusmodules)];
+
 struct Pertag {
   unsigned int curtag, prevtag; /* current and previous tag */
   int nmasters[LENGTH(tags) + 1]; /* number of windows in master area */
@@ -433,8 +778,50 @@ struct Pertag {
   unsigned int sellts[LENGTH(tags) + 1]; /* selected layouts */
   const Layout *ltidxs[LENGTH(tags) + 1][2]; /* matrix of tags and layouts indexes  */
   int showbars[LENGTH(tags) + 1]; /* display bar for the current tag */
+  char taglabels[LENGTH(tags)][64]; /* 标签名称和首个客户端名称的组合，在客户端增减或改变标签时更新 */
+};
+
+/* ~/.cache/dwm/session-$DISPLAY中的一份快照，checksum覆盖checksum之后的所有字节；
+ * 文件中有两个槽位轮流写入，写到一半崩溃时另一个槽位仍然完整 */
+struct Session {
+  unsigned int magic, version, ntags, checksum;
+  unsigned int stamp;                  /* 每次保存加1，用于淘汰最久未更新的places */
+  struct {
+    int valid;
+    unsigned int curtag, prevtag;
+    int nmasters[LENGTH(tags) + 1];
+    float mfacts[LENGTH(tags) + 1];
+    unsigned int sellts[LENGTH(tags) + 1];
+    int ltidxs[LENGTH(tags) + 1][2];   /* layouts中的下标 */
+    int showbars[LENGTH(tags) + 1];
+  } mons[8];
+  struct {
+    char class[64];                    /* 空表示未使用 */
+    unsigned int stamp;
+    int x, y, w, h;
+  } places[64];                        /* 按WM_CLASS记住的浮动窗口几何 */
 };
 
+static Session sessionbuf;             /* 内存中的当前快照 */
+static Session *session;               /* 没有快照文件时为NULL，否则指向sessionbuf */
+static Session *sessionslots;          /* mmap的文件，两个槽位 */
+static int sessionpending;             /* 已经设置了保存的定时器 */
+
+/* 当前生效的表，默认指向config.h中编译进来的表，运行时配置中出现的段会替换它们 */
+static const Key *ckeys = keys;
+static size_t nckeys = LENGTH(keys);
+static const Rule *crules = rules;
+static size_t ncrules = LENGTH(rules);
+static const TagMapEntry *ctagnamemap = tagnamemap;
+static size_t nctagnamemap = LENGTH(tagnamemap);
+static const char *ccolors[LENGTH(colors)][3];
+static Key *cfgkeys;          /* 运行时配置分配的表，重新加载时释放 */
+static const char **cfgargvs; /* spawn的argv，每个key占4项 */
+static Rule *cfgrules;
+static TagMapEntry *cfgtagmap;
+static char configpath[512];
+static int configfd = -1;
+
 static unsigned int scratchtag = 1 << LENGTH(tags);
 
 unsigned int tagw[LENGTH(tags)];
@@ -445,31 +832,38 @@ struct NumTags { char limitexceeded[LENGTH(tags) > 31 ? -1 : 1]; };
 /* function implementations */
 void
 applyrules(Client *c)
+{
+  c->tags = matchrules(c);
+  c->tags = c->tags & TAGMASK ? c->tags & TAGMASK : (c->mon->tagset[c->mon->seltags] & TAGMASK);
+}
+
+/* 把匹配规则的结果写入c，返回规则指定的tags，没有规则指定时为0 */
+unsigned int
+matchrules(Client *c)
 {
   const char *class, *instance;
-  unsigned int i;
+  unsigned int i, mask = 0;
   const Rule *r;
   Monitor *m;
-  XClassHint ch = { NULL, NULL };
 
   /* rule matching */
   c->isfloating = 0;
-  c->tags = 0;
   c->fixrender = 0;
-  XGetClassHint(dpy, c->win, &ch);
-  class    = ch.res_class ? ch.res_class : broken;
-  instance = ch.res_name  ? ch.res_name  : broken;
+  c->outline = outlinemode;
+  class    = c->class;
+  instance = c->instance;
 
-  for (i = 0; i < LENGTH(rules); i++) {
-    r = &rules[i];
+  for (i = 0; i < ncrules; i++) {
+    r = &crules[i];
     if ((!r->title || strstr(c->name, r->title))
     && (!r->class || strstr(class, r->class))
     && (!r->instance || strstr(instance, r->instance)))
     {
       c->isfloating = r->isfloating;
-      c->tags |= r->tags;
+      mask |= r->tags;
       c->bw = r->hideborder ? 0 : borderpx;
       c->fixrender = r->fixrender ? 1 : 0;
+      c->outline = r->outline || outlinemode;
       for (m = mons; m && m->num != r->monitor; m = m->next);
       if (m)
         c->mon = m;
@@ -489,11 +883,7 @@ applyrules(Client *c)
       }
     }
   }
-  if (ch.res_class)
-    XFree(ch.res_class);
-  if (ch.res_name)
-    XFree(ch.res_name);
-  c->tags = c->tags & TAGMASK ? c->tags & TAGMASK : (c->mon->tagset[c->mon->seltags] & TAGMASK);
+  return mask & TAGMASK;
 }
 
 int
@@ -567,15 +957,11 @@ applysizehints(Client *c, int *x, int *y, int *w, int *h, int interact)
 void
 arrange(Monitor *m)
 {
+  // 仅标记，真正的布局在flushdirty中每批事件执行一次
   if (m)
-    showhide(m->stack);
-  else for (m = mons; m; m = m->next)
-    showhide(m->stack);
-  if (m) {
-    arrangemon(m);
-    restack(m);
-  } else for (m = mons; m; m = m->next)
-    arrangemon(m);
+    markdirty(m, DirtyLayout|DirtyStack|DirtyBar);
+  else
+    markdirty(NULL, DirtyLayout|DirtyBar);
 }
 
 void
@@ -599,6 +985,7 @@ attachbottom(Client *c)
   c->next = NULL;
   for (tc = &c->mon->clients; *tc; tc = &(*tc)->next);
   *tc = c;
+  updatetaglabels(c->mon);
 }
 
 void
@@ -606,6 +993,7 @@ attach(Client *c)
 {
   c->next = c->mon->clients;
   c->mon->clients = c;
+  updatetaglabels(c->mon);
 }
 
 void
@@ -689,7 +1077,7 @@ checkotherwm(void)
   xerrorxlib = XSetErrorHandler(xerrorstart);
   /* this causes an error if some other window manager is running */
   XSelectInput(dpy, DefaultRootWindow(dpy), SubstructureRedirectMask);
-  XSync(dpy, False);
+  XSync(dpy, False); /* 同步点：必须在换回xerror之前收到可能的BadAccess */
   XSetErrorHandler(xerror);
   XSync(dpy, False);
 }
@@ -702,11 +1090,26 @@ cleanup(void)
   Monitor *m;
   size_t i;
 
+  if (session) {
+    savesession(NULL);
+    munmap(sessionslots, 2 * sizeof(Session));
+    sessionslots = NULL;
+    session = NULL;
+  }
   view(&a);
+  flushdirty();
   selmon->lt[selmon->sellt] = &foo;
+  /* 所有窗口只grab server和同步一次 */
+  bulk = 1;
+  XGrabServer(dpy);
+  XSetErrorHandler(xerrordummy);
   for (m = mons; m; m = m->next)
     while (m->stack)
       unmanage(m->stack, 0);
+  XSync(dpy, False); /* 同步点：错误要在xerrordummy生效期间收到 */
+  XSetErrorHandler(xerror);
+  XUngrabServer(dpy);
+  bulk = 0;
   XUngrabKey(dpy, AnyKey, AnyModifier, root);
   while (mons)
     cleanupmon(mons);
@@ -720,13 +1123,68 @@ cleanup(void)
   for (i = 0; i < LENGTH(colors); i++)
     free(scheme[i]);
   free(scheme);
+  free(cfgkeys);
+  free(cfgargvs);
+  free(cfgrules);
+  free(cfgtagmap);
+  if (configfd >= 0) {
+    unwatchfd(configfd);
+    close(configfd);
+    configfd = -1;
+  }
   XDestroyWindow(dpy, wmcheckwin);
+  for (i = 0; i < LENGTH(outlinewins); i++)
+    if (outlinewins[i])
+      XDestroyWindow(dpy, outlinewins[i]);
+  cleanupipc();
+  cleanupstatusmodules();
+  free(wintab);
   drw_free(drw);
-  XSync(dpy, False);
+  XSync(dpy, False); /* 同步点：退出前确保上面的请求都已被处理 */
   XSetInputFocus(dpy, PointerRoot, RevertToPointerRoot, CurrentTime);
   XDeleteProperty(dpy, root, netatom[NetActiveWindow]);
 }
 
+void
+cleanupipc(void)
+{
+  unsigned int i;
+
+  for (i = 0; i < LENGTH(ipcconns); i++)
+    if (ipcconns[i].fd >= 0)
+      ipcclose(&ipcconns[i]);
+  if (ipcfd >= 0) {
+    unwatchfd(ipcfd);
+    close(ipcfd);
+    unlink(ipcpath);
+    ipcfd = -1;
+  }
+  if (statusfd >= 0) {
+    unwatchfd(statusfd);
+    close(statusfd);
+    unlink(statuspath);
+    statusfd = -1;
+  }
+}
+
+void
+cleanupstatusmodules(void)
+{
+  unsigned int i;
+
+  for (i = 0; i < LENGTH(statusstates); i++) {
+    if (statusstates[i].fd[0] >= 0)
+      close(statusstates[i].fd[0]);
+    if (statusstates[i].fd[1] >= 0)
+      close(statusstates[i].fd[1]);
+  }
+  if (statustimerfd >= 0) {
+    unwatchfd(statustimerfd);
+    close(statustimerfd);
+    statustimerfd = -1;
+  }
+}
+
 void
 cleanupmon(Monitor *mon)
 {
@@ -738,6 +1196,7 @@ cleanupmon(Monitor *mon)
     for (m = mons; m && m->next != mon; m = m->next);
     m->next = mon->next;
   }
+  wintabdel(mon->barwin);
   XUnmapWindow(dpy, mon->barwin);
   XDestroyWindow(dpy, mon->barwin);
   if (mon->pertag) {
@@ -772,6 +1231,7 @@ clientmessage(XEvent *e)
       c->mon = selmon;
       c->next = systray->icons;
       systray->icons = c;
+      wintabput(c->win, WinSystrayIcon, c);
       XGetWindowAttributes(dpy, c->win, &wa);
       c->x = c->oldx = c->y = c->oldy = 0;
       c->w = c->oldw = wa.width;
@@ -794,7 +1254,6 @@ clientmessage(XEvent *e)
       sendevent(c->win, netatom[Xembed], StructureNotifyMask, CurrentTime, XEMBED_FOCUS_IN, 0 , systray->win, XEMBED_EMBEDDED_VERSION);
       sendevent(c->win, netatom[Xembed], StructureNotifyMask, CurrentTime, XEMBED_WINDOW_ACTIVATE, 0 , systray->win, XEMBED_EMBEDDED_VERSION);
       sendevent(c->win, netatom[Xembed], StructureNotifyMask, CurrentTime, XEMBED_MODALITY_ON, 0 , systray->win, XEMBED_EMBEDDED_VERSION);
-      XSync(dpy, False);
       resizebarwin(selmon);
       updatesystray();
       setclientstate(c, NormalState);
@@ -816,6 +1275,87 @@ clientmessage(XEvent *e)
   }
 }
 
+/* 只发送want与have不同的部分，没有变化时不产生任何请求 */
+void
+commitgeom(Client *c)
+{
+  XWindowChanges wc;
+  unsigned int mask = 0;
+
+  if (c == outlineclient)
+    return;
+  if (c->want.x != c->have.x)
+    mask |= CWX;
+  if (c->want.y != c->have.y)
+    mask |= CWY;
+  if (c->want.w != c->have.w)
+    mask |= CWWidth;
+  if (c->want.h != c->have.h)
+    mask |= CWHeight;
+  if (c->want.bw != c->have.bw)
+    mask |= CWBorderWidth;
+#ifdef XSYNC
+  if (c == syncclient && mask & (CWWidth|CWHeight))
+    syncrequest(c);
+#endif
+  if (mask) {
+    wc.x = c->want.x;
+    wc.y = c->want.y;
+    wc.width = c->want.w;
+    wc.height = c->want.h;
+    wc.border_width = c->want.bw;
+    XConfigureWindow(dpy, c->win, mask, &wc);
+  }
+  c->have = c->want;
+  /* 拖动中只移动位置时不发合成的ConfigureNotify，拖动结束时由movemouse补发 */
+  if (mask && c->configpending && (c != dragclient || mask & ~(CWX|CWY)))
+    configure(c);
+  c->configpending = 0;
+}
+
+/* 提交本批事件中布局计算出的所有窗口几何 */
+void
+commitgeoms(void)
+{
+  Monitor *m;
+  Client *c;
+
+  if (!geomdirty)
+    return;
+  geomdirty = 0;
+  for (m = mons; m; m = m->next)
+    for (c = m->stack; c; c = c->snext)
+      commitgeom(c);
+}
+
+/* 外部文本和各模块文本用statussep连接，结果没有变化时不重绘，宽度不变时只重绘状态区域 */
+void
+composestatus(void)
+{
+  char text[sizeof stext];
+  size_t len;
+  unsigned int i;
+  int w;
+
+  len = snprintf(text, sizeof text, "%s", exttext);
+  for (i = 0; i < LENGTH(statusstates) && len < sizeof text - 1; i++) {
+    if (!statusstates[i].text[0])
+      continue;
+    len += snprintf(text + len, sizeof text - len, "%s%s",
+      len ? statussep : "", statusstates[i].text);
+  }
+  if (!strcmp(text, stext))
+    return;
+  w = TEXTW(stext);
+  strcpy(stext, text);
+  if (TEXTW(stext) == w)
+    markdirty(selmon, DirtyStatus);
+  else {
+    markdirty(selmon, DirtyBar);
+    updatesystray();
+  }
+}
+
 void
 configure(Client *c)
 {
@@ -898,8 +1438,13 @@ configurerequest(XEvent *e)
         c->y = m->my + (m->mh / 2 - HEIGHT(c) / 2); /* center in y direction */
       if ((ev->value_mask & (CWX|CWY)) && !(ev->value_mask & (CWWidth|CWHeight)))
         configure(c);
-      if (ISVISIBLE(c))
-        XMoveResizeWindow(dpy, c->win, c->x, c->y, c->w, c->h);
+      if (ISVISIBLE(c)) {
+        c->want.x = c->x;
+        c->want.y = c->y;
+        c->want.w = c->w;
+        c->want.h = c->h;
+        geomdirty = 1;
+      }
     } else
       configure(c);
   } else {
@@ -912,7 +1457,6 @@ configurerequest(XEvent *e)
     wc.stack_mode = ev->detail;
     XConfigureWindow(dpy, ev->window, ev->value_mask, &wc);
   }
-  XSync(dpy, False);
 }
 
 Monitor *
@@ -931,6 +1475,7 @@ createmon(void)
   m->gappiv = gappiv;
   m->gappoh = gappoh;
   m->gappov = gappov;
+  m->refresh = refreshrate;
   m->lt[0] = &layouts[0];
   m->lt[1] = &layouts[1 % LENGTH(layouts)];
   strncpy(m->ltsymbol, layouts[0].symbol, sizeof m->ltsymbol);
@@ -949,26 +1494,18 @@ createmon(void)
 
     m->pertag->showbars[i] = m->showbar;
   }
+  updatetaglabels(m);
 
   return m;
 }
 
-// dump当前dwm的状态
+// dump当前dwm的状态，忽略缓存强制重写所有状态文件
 static
 void dumpstatus(void) {
-  char cmd[1024];
-
-  if (selmon) {
-    snprintf(cmd, sizeof(cmd),
-        "/bin/bash -c 'mkdir -p ~/.cache/dwm/status && echo %d > ~/.cache/dwm/status/selmon'", selmon->num);
-    system(cmd);
-  }
-
-  if (selmon && selmon->sel) {
-    snprintf(cmd, sizeof(cmd),
-        "/bin/bash -c 'mkdir -p ~/.cache/dwm/status && echo %lu > ~/.cache/dwm/status/selwin'", selmon->sel->win);
-    system(cmd);
-  }
+  published.selmon = -1;
+  published.selwin = None;
+  published.seltags = 0;
+  savestatus(NULL);
 }
 
 void
@@ -993,6 +1530,7 @@ detach(Client *c)
 
   for (tc = &c->mon->clients; *tc && *tc != c; tc = &(*tc)->next);
   *tc = c->next;
+  updatetaglabels(c->mon);
 
   removeaccstack(c);
 }
@@ -1026,19 +1564,16 @@ dirtomon(int dir)
   return m;
 }
 
-// 获取用于标签的客户端名称
-const char* 
-gettagdisplayname(Client* c) {
-  XClassHint ch = { NULL, NULL };
-  XGetClassHint(dpy, c->win, &ch);
-  const char* name = ch.res_class;
-  for (int i = 0; i < LENGTH(tagnamemap); i++) {
-    if (name && strcmp(tagnamemap[i].key, name) == 0) {
-      name = tagnamemap[i].val;
-      break;
-    }
+// 获取用于标签的客户端名称，class为NULL时返回NULL
+const char *
+gettagdisplayname(const char *class) {
+  if (!class)
+    return NULL;
+  for (int i = 0; i < nctagnamemap; i++) {
+    if (strcmp(ctagnamemap[i].key, class) == 0)
+      return ctagnamemap[i].val;
   }
-  return name;
+  return class;
 }
 
 void
@@ -1064,8 +1599,6 @@ drawbar(Monitor *m)
   int boxw = drw->fonts->h / 6 + 2;
   unsigned int i, occ = 0, urg = 0, n = 0;
   Client *c;
-  char tagdisp[64];
-  const char *masterclientontag[LENGTH(tags)];
 
   if(showsystray && m == systraytomon(m))
     stw = getsystraywidth();
@@ -1080,21 +1613,12 @@ drawbar(Monitor *m)
 
   resizebarwin(m);
 
-  // 初始化各个标签master客户端数组
-  for (i = 0; i < LENGTH(tags); i++)
-    masterclientontag[i] = NULL;
-
   for (c = m->clients; c; c = c->next) {
     if (ISVISIBLE(c))
       n++; // 计算可展示的客户端数量
     occ |= c->tags;
     if (c->isurgent)
       urg |= c->tags;
-    // 获取master客户端的名称
-    for (i = 0; i < LENGTH(tags); i++)
-      if (!masterclientontag[i] && c->tags & (1<<i)) {
-        masterclientontag[i] = gettagdisplayname(c);
-      }
   }
   x = 0;
   // 绘制tags
@@ -1108,14 +1632,9 @@ drawbar(Monitor *m)
       /* Do not draw vacant tags */
       if(!(occ & 1 << i || m->tagset[m->seltags] & 1 << i))
         continue;
-      if (masterclientontag[i])
-        snprintf(tagdisp, 64, ptagf, tags[i], masterclientontag[i]);
-      else
-        snprintf(tagdisp, 64, etagf, tags[i]);
-      masterclientontag[i] = tagdisp;
-      tagw[i] = w = TEXTW(masterclientontag[i]);
+      tagw[i] = w = TEXTW(m->pertag->taglabels[i]);
       drw_setscheme(drw, scheme[m->tagset[m->seltags] & 1 << i ? SchemeSel : SchemeNorm]);
-      drw_text(drw, x, 0, w, bh, lrpad / 2, masterclientontag[i], urg & 1 << i);
+      drw_text(drw, x, 0, w, bh, lrpad / 2, m->pertag->taglabels[i], urg & 1 << i);
       x += w;
     }
   }
@@ -1174,13 +1693,99 @@ drawbar(Monitor *m)
   drw_map(drw, m->barwin, 0, 0, m->ww - stw, bh);
 }
 
+/* 取消所有参数为arg的定时器，arg被释放前调用 */
+void
+deltimers(void *arg)
+{
+  unsigned int i;
+
+  for (i = 0; i < LENGTH(timers); i++)
+    if (timers[i].when && timers[i].arg == arg)
+      timers[i].when = 0;
+}
+
+/* movemouse、resizemouse中关心的事件，其余的留在队列里由主循环处理 */
+Bool
+dragevent(Display *d, XEvent *ev, XPointer arg)
+{
+  switch (ev->type) {
+  case ButtonPress:
+  case ButtonRelease:
+  case MotionNotify:
+  case Expose:
+  case ConfigureRequest:
+  case MapRequest:
+  case CirculateRequest:
+    return True;
+  }
+#ifdef XSYNC
+  return syncevbase >= 0 && ev->type == syncevbase + XSyncAlarmNotify;
+#else
+  return False;
+#endif /* XSYNC */
+}
+
 void
 drawbars(void)
 {
-  Monitor *m;
+  markdirty(NULL, DirtyBar);
+}
 
-  for (m = mons; m; m = m->next)
-    drawbar(m);
+/* 用四个override-redirect窗口画出c待提交的几何，不配置client本身 */
+void
+drawoutline(Client *c)
+{
+  XSetWindowAttributes wa = {
+    .override_redirect = True,
+    .background_pixel = scheme[SchemeSel][ColBorder].pixel,
+    .border_pixel = 0,
+    .colormap = cmap
+  };
+  int i, t = MAX(c->bw, 2);
+  int x = c->want.x, y = c->want.y;
+  int w = c->want.w + 2 * c->want.bw, h = c->want.h + 2 * c->want.bw;
+  int r[4][4] = {
+    { x, y, w, t }, { x, y + h - t, w, t },
+    { x, y, t, h }, { x + w - t, y, t, h }
+  };
+
+  if (!memcmp(&outlinegeom, &c->want, sizeof outlinegeom))
+    return;
+  outlinegeom = c->want;
+  for (i = 0; i < LENGTH(outlinewins); i++) {
+    if (!outlinewins[i])
+      outlinewins[i] = XCreateWindow(dpy, root, 0, 0, 1, 1, 0, depth, InputOutput, visual,
+                                     CWOverrideRedirect|CWBackPixel|CWBorderPixel|CWColormap, &wa);
+    XMoveResizeWindow(dpy, outlinewins[i], r[i][0], r[i][1], r[i][2], r[i][3]);
+    XMapRaised(dpy, outlinewins[i]);
+  }
+}
+
+#ifdef STATS
+/* 输出到stderr，可以绑定到signals或按键 */
+void
+dumpstats(const Arg *arg)
+{
+  static char buf[8192];
+
+  fwrite(buf, 1, formatstats(buf, sizeof buf), stderr);
+}
+#endif
+
+/* 只重绘状态文本区域，调用者保证文本宽度没有变化 */
+void
+drawstatus(Monitor *m)
+{
+  int tw, stw = 0;
+
+  if (m != selmon || !m->showbar)
+    return;
+  if (showsystray && m == systraytomon(m))
+    stw = getsystraywidth();
+  drw_setscheme(drw, scheme[SchemeNorm]);
+  tw = TEXTW(stext) - lrpad / 2 + 2; /* 2px right padding */
+  drw_text(drw, m->ww - tw - stw, 0, tw, bh, lrpad / 2 - 2, stext, 0);
+  drw_map(drw, m->barwin, m->ww - tw - stw, 0, tw, bh);
 }
 
 void
@@ -1213,15 +1818,138 @@ expose(XEvent *e)
   XExposeEvent *ev = &e->xexpose;
 
   if (ev->count == 0 && (m = wintomon(ev->window))) {
-    drawbar(m);
+    markdirty(m, DirtyBar);
     if (m == selmon)
       updatesystray();
   }
 }
 
+/* 执行本批事件中累积的arrange/restack/drawbar，每个monitor每批最多一次 */
+void
+flushdirty(void)
+{
+  Monitor *m;
+  unsigned int dirty;
+#ifdef STATS
+  long long t;
+#define STATOP(op, req, call) do { REQBEGIN; t = getus(); call; \
+  statrecord(&opstats[op], t, m->sel ? m->sel->win : m->barwin); REQEND(req); } while (0)
+#else
+#define STATOP(op, req, call) call
+#endif
+
+  /* 布局或窗口几何变化时推迟保存会话快照 */
+  for (m = mons; m; m = m->next)
+    if (m->dirty & DirtyLayout) {
+      showhide(m->stack);
+      marksession();
+    }
+  if (geomdirty)
+    marksession();
+  for (m = mons; m; m = m->next)
+    if (m->dirty & DirtyLayout)
+      STATOP(StatArrange, ReqArrange, arrangemon(m));
+  /* 轮廓模式中的client被切换到其他tag时直接结束，提交隐藏它的几何 */
+  if (outlineclient && !ISVISIBLE(outlineclient))
+    outlineend(outlineclient);
+  /* 在restack的XSync之前提交，restack会丢弃窗口移动产生的EnterNotify */
+  commitgeoms();
+  if (outlineclient)
+    drawoutline(outlineclient);
+  for (m = mons; m; m = m->next) {
+    dirty = m->dirty;
+    m->dirty = 0;
+    if (dirty & DirtyStack)
+      STATOP(StatRestack, ReqRestack, restackmon(m));
+    if (dirty & DirtyBar)
+      STATOP(StatDrawbar, ReqDrawbar, drawbar(m));
+    else if (dirty & DirtyStatus)
+      STATOP(StatDrawbar, ReqDrawbar, drawstatus(m));
+  }
+#undef STATOP
+  if (clientlistdirty) {
+    clientlistdirty = 0;
+    updateclientlist();
+  }
+  publishstatus();
+  publishevents();
+}
+
+#ifdef STATS
+/* 检查各操作单次的最大round trip数是否超出config.h中的rtbudgets，超出时回复error */
+size_t
+checkbudgets(char *buf, size_t size)
+{
+  size_t len = 0;
+  unsigned int i, j;
+
+  for (i = 0; i < LENGTH(rtbudgets); i++)
+    for (j = 0; j < ReqLast; j++)
+      if (!strcmp(rtbudgets[i].op, reqnames[j]) && reqstats[j].maxroundtrips > rtbudgets[i].roundtrips)
+        len += snprintf(buf + len, size - len, "%s%s %lu > %lu",
+          len ? ", " : "error: round trip budget exceeded: ",
+          reqnames[j], reqstats[j].maxroundtrips, rtbudgets[i].roundtrips);
+  len += snprintf(buf + len, size - len, "%s\n", len ? "" : "ok");
+  return MIN(len, size - 1);
+}
+
+/* 以config.h中rtbudgets的格式输出自reset以来各操作单次的最大round trip数 */
+size_t
+formatbudgets(char *buf, size_t size)
+{
+  size_t len = 0;
+  unsigned int i;
+
+  len += snprintf(buf + len, size - len, "  /* operation    round trips */\n");
+  for (i = 0; i < ReqLast && len < size; i++)
+    if (reqstats[i].count)
+      len += snprintf(buf + len, size - len, "  { \"%s\",%*s%lu },  /* max of %lu calls */\n",
+        reqnames[i], (int)(10 - strlen(reqnames[i])), "", reqstats[i].maxroundtrips, reqstats[i].count);
+    else
+      len += snprintf(buf + len, size - len, "  /* %s: not run since reset */\n", reqnames[i]);
+  return MIN(len, size - 1);
+}
+
+/* 每行一项：名称 次数 平均us 最大us 最大时的窗口 直方图(2^i us:次数) */
+size_t
+formatstats(char *buf, size_t size)
+{
+  size_t len;
+  unsigned int i, j;
+  Stat *st;
+  const char *name;
+
+  len = snprintf(buf, size, "# %llds, name count avg(us) max(us) maxwin log2(us):count...\n",
+    (getus() - statsince) / 1000000);
+  for (i = 0; i < LASTEvent + StatLast && len < size; i++) {
+    st = i < LASTEvent ? &evstats[i] : &opstats[i - LASTEvent];
+    name = i < LASTEvent ? evnames[i] : opnames[i - LASTEvent];
+    if (!st->count || !name)
+      continue;
+    len += snprintf(buf + len, size - len, "%s %lu %llu %lu 0x%lx",
+      name, st->count, st->total / st->count, st->max, st->maxwin);
+    for (j = 0; j < LENGTH(st->hist) && len < size; j++)
+      if (st->hist[j])
+        len += snprintf(buf + len, size - len, " %u:%lu", j, st->hist[j]);
+    if (len < size)
+      len += snprintf(buf + len, size - len, "\n");
+  }
+  if (len < size)
+    len += snprintf(buf + len, size - len,
+      "# op count requests roundtrips flushes maxrequests maxroundtrips\n");
+  for (i = 0; i < ReqLast && len < size; i++)
+    if (reqstats[i].count)
+      len += snprintf(buf + len, size - len, "%s %lu %llu %llu %llu %lu %lu\n", reqnames[i],
+        reqstats[i].count, reqstats[i].requests, reqstats[i].roundtrips,
+        reqstats[i].flushes, reqstats[i].maxrequests, reqstats[i].maxroundtrips);
+  return MIN(len, size - 1);
+}
+#endif
+
 void
 focus(Client *c)
 {
+  REQBEGIN;
   // 如果c为NULL或c在当前选中tags下不可见，则找到第一个可见的c
   if (!c || !ISVISIBLE(c))
     for (c = selmon->stack; c && !ISVISIBLE(c); c = c->snext);
@@ -1245,7 +1973,7 @@ focus(Client *c)
     attachstack(c);
     grabbuttons(c, 1);
     // 设置边框
-    XSetWindowBorder(dpy, c->win, scheme[SchemeSel][ColBorder].pixel);
+    setborderpixel(c, scheme[SchemeSel][ColBorder].pixel);
     // 下面的代码为了避免边框闪烁，但这会使得monocle模式切换回title时因为无法重新触发focus导致边框不显示
     // 我暂时还没有遇到边框闪烁的问题，因此暂时注释这个补丁的内容
     /* Avoid flickering when another client appears and the border
@@ -1261,6 +1989,7 @@ focus(Client *c)
   setmonsel(selmon, c);
   drawbars();
   addaccstack(c);
+  REQEND(ReqFocus);
 }
 
 /* there are some broken focus acquiring clients needing extra handling */
@@ -1298,6 +2027,17 @@ focusmonbyclient(Client *c) {
   focus(NULL);
 }
 
+void
+fixrender(void *arg)
+{
+  Client *c = arg;
+
+  if (!c->fixpending)
+    return;
+  c->fixpending = 0;
+  resizeclient(c, c->fixx, c->fixy, c->fixw, c->fixh);
+}
+
 void
 focusstack(const Arg *arg)
 {
@@ -1339,6 +2079,24 @@ focusclient(const Arg *arg) {
   }
 }
 
+long long
+getms(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+long long
+getus(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
 Atom
 getatomprop(Client *c, Atom prop)
 {
@@ -1351,6 +2109,15 @@ getatomprop(Client *c, Atom prop)
   Atom req = XA_ATOM;
   if (prop == xatom[XembedInfo])
     req = xatom[XembedInfo];
+#ifdef XCB
+  xcb_get_property_reply_t *r;
+
+  if (prefetched(c->win, prop, &r)) {
+    if (r && r->type == req && r->format == 32 && r->value_len)
+      atom = *(uint32_t *)xcb_get_property_value(r);
+    return atom;
+  }
+#endif
 
   if (XGetWindowProperty(dpy, c->win, prop, 0L, sizeof atom, False, req,
     &da, &di, &dl, &dl, &p) == Success && p) {
@@ -1380,6 +2147,15 @@ getstate(Window w)
   unsigned char *p = NULL;
   unsigned long n, extra;
   Atom real;
+#ifdef XCB
+  xcb_get_property_reply_t *r;
+
+  if (prefetched(w, wmatom[WMState], &r)) {
+    if (r && r->type == wmatom[WMState] && r->format == 32 && r->value_len)
+      result = *(uint32_t *)xcb_get_property_value(r);
+    return result;
+  }
+#endif
 
   if (XGetWindowProperty(dpy, w, wmatom[WMState], 0L, 2L, False, wmatom[WMState],
     &real, &format, &n, &extra, (unsigned char **)&p) != Success)
@@ -1406,10 +2182,27 @@ gettextprop(Window w, Atom atom, char *text, unsigned int size)
   char **list = NULL;
   int n;
   XTextProperty name;
+#ifdef XCB
+  xcb_get_property_reply_t *r;
+  unsigned char buf[1024];
+#endif
 
   if (!text || size == 0)
     return 0;
   text[0] = '\0';
+#ifdef XCB
+  if (prefetched(w, atom, &r)) {
+    /* 复制成以0结尾的值，之后与XGetTextProperty的结果一样处理 */
+    if (!r || r->format != 8 || !(n = MIN(r->value_len, sizeof buf - 1)))
+      return 0;
+    memcpy(buf, xcb_get_property_value(r), n);
+    buf[n] = '\0';
+    name.value = buf;
+    name.encoding = r->type;
+    name.format = 8;
+    name.nitems = n;
+  } else
+#endif
   if (!XGetTextProperty(dpy, w, &name, atom) || !name.nitems)
     return 0;
   if (name.encoding == XA_STRING) {
@@ -1419,10 +2212,29 @@ gettextprop(Window w, Atom atom, char *text, unsigned int size)
     XFreeStringList(list);
   }
   text[size - 1] = '\0';
+#ifdef XCB
+  if (name.value != buf)
+#endif
   XFree(name.value);
   return 1;
 }
 
+int
+gettransient(Window w, Window *trans)
+{
+#ifdef XCB
+  xcb_get_property_reply_t *r;
+
+  if (prefetched(w, XA_WM_TRANSIENT_FOR, &r)) {
+    if (!r || r->type != XA_WINDOW || r->format != 32 || !r->value_len)
+      return 0;
+    *trans = *(uint32_t *)xcb_get_property_value(r);
+    return 1;
+  }
+#endif
+  return XGetTransientForHint(dpy, w, trans);
+}
+
 void
 grabbuttons(Client *c, int focused)
 {
@@ -1454,10 +2266,10 @@ grabkeys(void)
     KeyCode code;
 
     XUngrabKey(dpy, AnyKey, AnyModifier, root);
-    for (i = 0; i < LENGTH(keys); i++)
-      if ((code = XKeysymToKeycode(dpy, keys[i].keysym)))
+    for (i = 0; i < nckeys; i++)
+      if ((code = XKeysymToKeycode(dpy, ckeys[i].keysym)))
         for (j = 0; j < LENGTH(modifiers); j++)
-          XGrabKey(dpy, code, keys[i].mod | modifiers[j], root,
+          XGrabKey(dpy, code, ckeys[i].mod | modifiers[j], root,
             True, GrabModeAsync, GrabModeAsync);
   }
 }
@@ -1470,6 +2282,17 @@ hide(const Arg *arg)
 	arrange(selmon);
 }
 
+void
+hideoutline(void)
+{
+  int i;
+
+  outlinegeom.w = 0;
+  for (i = 0; i < LENGTH(outlinewins); i++)
+    if (outlinewins[i])
+      XUnmapWindow(dpy, outlinewins[i]);
+}
+
 void
 hidewin(Client *c) {
 	if (!c || HIDDEN(c))
@@ -1509,89 +2332,388 @@ incnmaster(const Arg *arg)
   arrange(selmon);
 }
 
-#ifdef XINERAMA
-static int
-isuniquegeom(XineramaScreenInfo *unique, size_t n, XineramaScreenInfo *info)
+// 驻留字符串，相同内容返回同一指针，表项不会被释放
+const char *
+intern(const char *s)
 {
-  while (n--)
-    if (unique[n].x_org == info->x_org && unique[n].y_org == info->y_org
-    && unique[n].width == info->width && unique[n].height == info->height)
-      return 0;
-  return 1;
+  unsigned int h = 5381;
+  const char *p;
+  InternStr *i;
+
+  for (p = s; *p; p++)
+    h = h * 33 + (unsigned char)*p;
+  h &= LENGTH(interntab) - 1;
+  for (i = interntab[h]; i; i = i->next)
+    if (!strcmp(i->s, s))
+      return i->s;
+  i = ecalloc(1, sizeof(InternStr) + strlen(s) + 1);
+  strcpy(i->s, s);
+  i->next = interntab[h];
+  interntab[h] = i;
+  return i->s;
 }
-#endif /* XINERAMA */
 
 void
-keypress(XEvent *e)
+ipcaccept(int fd, short revents)
 {
+  int cfd;
   unsigned int i;
-  KeySym keysym;
-  XKeyEvent *ev;
 
-  ev = &e->xkey;
-  keysym = XKeycodeToKeysym(dpy, (KeyCode)ev->keycode, 0);
-  for (i = 0; i < LENGTH(keys); i++)
-    if (keysym == keys[i].keysym
-    && (keys[i].mod == NOMODKEY || CLEANMASK(keys[i].mod) == CLEANMASK(ev->state)) // 支持无mod快捷键
-    && keys[i].func) {
-      keys[i].func(&(keys[i].arg));
-      // 仅应用一个快捷键函数就退出，这样通过合适编排快捷键顺序来避免快捷键冲突
-      break;
-    }
+  if ((cfd = accept(fd, NULL, NULL)) < 0)
+    return;
+  for (i = 0; i < LENGTH(ipcconns) && ipcconns[i].fd >= 0; i++);
+  if (i == LENGTH(ipcconns) || watchfd(cfd, POLLIN, ipchandle) < 0) {
+    close(cfd);
+    return;
+  }
+  fcntl(cfd, F_SETFD, FD_CLOEXEC);
+  fcntl(cfd, F_SETFL, O_NONBLOCK);
+  ipcconns[i].fd = cfd;
+  ipcconns[i].subscribed = 0;
+  ipcconns[i].len = 0;
+  ipcconns[i].outlen = 0;
 }
 
-int
-fake_signal(void)
-{
-	char fsignal[256];
-	char indicator[9] = "fsignal:";
-	char str_signum[16];
-	int i, v, signum;
-	size_t len_fsignal, len_indicator = strlen(indicator);
-
-	// Get root name property
-	if (gettextprop(root, XA_WM_NAME, fsignal, sizeof(fsignal))) {
-		len_fsignal = strlen(fsignal);
-
-		// Check if this is indeed a fake signal
-		if (len_indicator > len_fsignal ? 0 : strncmp(indicator, fsignal, len_indicator) == 0) {
-			memcpy(str_signum, &fsignal[len_indicator], len_fsignal - len_indicator);
-			str_signum[len_fsignal - len_indicator] = '\0';
-
-			// Convert string value into managable integer
-			for (i = signum = 0; i < strlen(str_signum); i++) {
-				v = str_signum[i] - '0';
-				if (v >= 0 && v <= 9) {
-					signum = signum * 10 + v;
-				}
-			}
-
-			// Check if a signal was found, and if so handle it
-			if (signum)
-				for (i = 0; i < LENGTH(signals); i++)
-					if (signum == signals[i].signum && signals[i].func)
-						signals[i].func(&(signals[i].arg));
+void
+ipcclose(IpcConn *conn)
+{
+  unwatchfd(conn->fd);
+  close(conn->fd);
+  conn->fd = -1;
+  if (conn->subscribed)
+    nsubscribers--;
+  conn->subscribed = 0;
+}
 
-			// A fake signal was sent
-			return 1;
-		}
-	}
+/* 向所有订阅者推送一行事件，fmt不含换行 */
+void
+ipcevent(const char *fmt, ...)
+{
+  char buf[512];
+  unsigned int i;
+  int n, j;
+  va_list ap;
 
-	// No fake signal was sent, so proceed with update
-	return 0;
+  if (!nsubscribers)
+    return;
+  va_start(ap, fmt);
+  n = vsnprintf(buf, sizeof buf - 1, fmt, ap);
+  va_end(ap);
+  if (n < 0)
+    return;
+  n = MIN(n, (int)sizeof buf - 2);
+  for (j = 0; j < n; j++)
+    if (buf[j] == '\n')
+      buf[j] = ' ';
+  buf[n++] = '\n';
+  for (i = 0; i < LENGTH(ipcconns); i++)
+    if (ipcconns[i].fd >= 0 && ipcconns[i].subscribed)
+      ipcqueue(&ipcconns[i], buf, n);
 }
 
+/* 执行一行命令：<name> [arg]，命令表见config.h中的commands */
 void
-killclient(const Arg *arg)
+ipcexec(IpcConn *conn, char *line)
 {
-  if (!selmon->sel)
+  char *name, *val;
+  const char *err;
+  unsigned int i;
+  long n;
+  Arg arg = {0};
+
+  /* status的参数是整行剩余的文本 */
+  if (!strncmp(line, "status", 6) && (!line[6] || line[6] == ' ')) {
+    setstatus(line[6] ? line + 7 : "");
+    ipcreply(conn, "ok\n");
     return;
-  if (!sendevent(selmon->sel->win, wmatom[WMDelete], NoEventMask, wmatom[WMDelete], CurrentTime, 0 , 0, 0)) {
-    XGrabServer(dpy);
+  }
+  if (!(name = strtok(line, " \t")))
+    return;
+  val = strtok(NULL, " \t");
+  if (!strcmp(name, "subscribe")) {
+    if (!conn->subscribed) {
+      conn->subscribed = 1;
+      nsubscribers++;
+    }
+    ipcreply(conn, "ok\n");
+    ipcsnapshot(conn);
+    return;
+  }
+#ifdef STATS
+  if (!strcmp(name, "stats")) {
+    static char buf[sizeof conn->out];
+
+    if (val && !strcmp(val, "reset")) {
+      memset(evstats, 0, sizeof evstats);
+      memset(opstats, 0, sizeof opstats);
+      memset(reqstats, 0, sizeof reqstats);
+      statsince = getus();
+      ipcreply(conn, "ok\n");
+      return;
+    }
+    if (val && !strcmp(val, "check")) {
+      ipcqueue(conn, buf, checkbudgets(buf, sizeof buf));
+      return;
+    }
+    if (val && !strcmp(val, "budgets")) {
+      ipcqueue(conn, buf, formatbudgets(buf, sizeof buf));
+      return;
+    }
+    ipcqueue(conn, buf, formatstats(buf, sizeof buf));
+    return;
+  }
+#endif
+  if (!strcmp(name, "signal")) {
+    n = val ? strtol(val, NULL, 10) : 0;
+    for (i = 0; i < LENGTH(signals); i++)
+      if (n == signals[i].signum && signals[i].func) {
+        signals[i].func(&(signals[i].arg));
+        ipcreply(conn, "ok\n");
+        return;
+      }
+    ipcreply(conn, "error: unknown signal\n");
+    return;
+  }
+  for (i = 0; i < LENGTH(commands) && strcmp(name, commands[i].name); i++);
+  if (i == LENGTH(commands)) {
+    ipcreply(conn, "error: unknown command '%s'\n", name);
+    return;
+  }
+  if ((err = parsecmdarg(commands[i].argtype, val, &arg))) {
+    ipcreply(conn, "error: %s\n", err);
+    return;
+  }
+  commands[i].func(&arg);
+  ipcreply(conn, "ok\n");
+}
+
+/* 把命令的参数解析到arg，ipc和运行时配置的key共用，成功返回NULL */
+const char *
+parsecmdarg(int argtype, const char *val, Arg *arg)
+{
+  char *end;
+  long n = 0;
+
+  memset(arg, 0, sizeof *arg);
+  if (!val || argtype == IpcArgNone)
+    return NULL;
+  errno = 0;
+  if (argtype == IpcArgFloat)
+    arg->f = strtof(val, &end);
+  else
+    n = strtol(val, &end, 10);
+  if (errno || *end)
+    return "invalid argument";
+  switch (argtype) {
+  case IpcArgInt:  arg->i = n; break;
+  case IpcArgUint: arg->ui = n; break;
+  case IpcArgTag: /* 标签从1开始，0表示所有标签 */
+    if (n < 0 || n > LENGTH(tags))
+      return "no such tag";
+    arg->ui = n ? 1 << (n - 1) : ~0;
+    break;
+  case IpcArgLayout:
+    if (n < 0 || n >= LENGTH(layouts))
+      return "no such layout";
+    arg->v = &layouts[n];
+    break;
+  }
+  return NULL;
+}
+
+/* 尽量写出队列，写不完时等待POLLOUT */
+void
+ipcflush(IpcConn *conn)
+{
+  ssize_t n;
+
+  while (conn->outlen) {
+    n = send(conn->fd, conn->out, conn->outlen, MSG_NOSIGNAL|MSG_DONTWAIT);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0 && errno == EAGAIN) {
+      watchevents(conn->fd, POLLIN|POLLOUT);
+      return;
+    }
+    if (n < 0) {
+      ipcclose(conn);
+      return;
+    }
+    conn->outlen -= n;
+    memmove(conn->out, conn->out + n, conn->outlen);
+  }
+  watchevents(conn->fd, POLLIN);
+}
+
+void
+ipchandle(int fd, short revents)
+{
+  IpcConn *conn = NULL;
+  char *line, *nl;
+  unsigned int i;
+  ssize_t n;
+
+  for (i = 0; i < LENGTH(ipcconns); i++)
+    if (ipcconns[i].fd == fd)
+      conn = &ipcconns[i];
+  if (!conn)
+    return;
+  if (revents & POLLOUT) {
+    ipcflush(conn);
+    if (conn->fd != fd)
+      return;
+  }
+  if (!(revents & (POLLIN|POLLERR|POLLHUP)))
+    return;
+  n = read(fd, conn->buf + conn->len, sizeof conn->buf - conn->len - 1);
+  if (n < 0 && (errno == EAGAIN || errno == EINTR))
+    return;
+  if (n <= 0) {
+    ipcclose(conn);
+    return;
+  }
+  conn->len += n;
+  conn->buf[conn->len] = '\0';
+  for (line = conn->buf; (nl = strchr(line, '\n')); line = nl + 1) {
+    *nl = '\0';
+    ipcexec(conn, line);
+    /* 命令产生的事件可能使本连接的队列溢出而被关闭 */
+    if (conn->fd != fd)
+      return;
+  }
+  conn->len -= line - conn->buf;
+  memmove(conn->buf, line, conn->len);
+  /* 超长的行直接丢弃 */
+  if (conn->len == sizeof conn->buf - 1)
+    conn->len = 0;
+}
+
+/* 读得慢的客户端在队列写满时被断开，不会阻塞dwm */
+void
+ipcqueue(IpcConn *conn, const char *s, size_t n)
+{
+  if (conn->outlen + n > sizeof conn->out) {
+    ipcclose(conn);
+    return;
+  }
+  memcpy(conn->out + conn->outlen, s, n);
+  conn->outlen += n;
+  ipcflush(conn);
+}
+
+void
+ipcreply(IpcConn *conn, const char *fmt, ...)
+{
+  char buf[256];
+  int n;
+  va_list ap;
+
+  va_start(ap, fmt);
+  n = vsnprintf(buf, sizeof buf, fmt, ap);
+  va_end(ap);
+  if (n > 0)
+    ipcqueue(conn, buf, MIN(n, (int)sizeof buf - 1));
+}
+
+/* 新订阅者先收到当前状态，之后只收到变化 */
+void
+ipcsnapshot(IpcConn *conn)
+{
+  Monitor *m;
+  Client *c;
+
+  for (m = mons; m && conn->fd >= 0; m = m->next) {
+    for (c = m->clients; c && conn->fd >= 0; c = c->next)
+      ipcreply(conn, "manage %d 0x%lx %s\n", m->num, c->win, c->class ? c->class : "");
+    if (conn->fd >= 0)
+      ipcreply(conn, "tags %d %u\nlayout %d %s\nfocus %d 0x%lx\n",
+        m->num, m->tagset[m->seltags], m->num, m->ltsymbol,
+        m->num, m->sel ? m->sel->win : None);
+  }
+  if (conn->fd >= 0 && selmon)
+    ipcreply(conn, "monitor %d\n", selmon->num);
+}
+
+#ifdef XINERAMA
+static int
+isuniquegeom(XineramaScreenInfo *unique, size_t n, XineramaScreenInfo *info)
+{
+  while (n--)
+    if (unique[n].x_org == info->x_org && unique[n].y_org == info->y_org
+    && unique[n].width == info->width && unique[n].height == info->height)
+      return 0;
+  return 1;
+}
+#endif /* XINERAMA */
+
+void
+keypress(XEvent *e)
+{
+  unsigned int i;
+  KeySym keysym;
+  XKeyEvent *ev;
+
+  ev = &e->xkey;
+  keysym = XKeycodeToKeysym(dpy, (KeyCode)ev->keycode, 0);
+  for (i = 0; i < nckeys; i++)
+    if (keysym == ckeys[i].keysym
+    && (ckeys[i].mod == NOMODKEY || CLEANMASK(ckeys[i].mod) == CLEANMASK(ev->state)) // 支持无mod快捷键
+    && ckeys[i].func) {
+      if (ckeys[i].func == movewin || ckeys[i].func == resizewin)
+        keyrepeat += keyrepeats(ev);
+      curkeycode = ev->keycode;
+      ckeys[i].func(&(ckeys[i].arg));
+      curkeycode = 0;
+      keyrepeat = 1;
+      // 仅应用一个快捷键函数就退出，这样通过合适编排快捷键顺序来避免快捷键冲突
+      break;
+    }
+}
+
+/* 松开mousemove的按键时停止对应方向的移动，全部松开后释放键盘 */
+void
+keyrelease(XEvent *e)
+{
+  unsigned int i;
+
+  if (!mousedirs)
+    return;
+  for (i = 0; i < LENGTH(mousekeys); i++)
+    if (mousedirs & 1 << i && mousekeys[i] == e->xkey.keycode)
+      mousedirs &= ~(1 << i);
+  if (!mousedirs)
+    XUngrabKeyboard(dpy, CurrentTime);
+}
+
+/* 取出队列头部连续的同一按键的自动重复，返回取出的个数 */
+int
+keyrepeats(XKeyEvent *ev)
+{
+  XEvent next;
+  int n = 0;
+
+  while (XEventsQueued(dpy, QueuedAfterReading)) {
+    XPeekEvent(dpy, &next);
+    if (next.type != KeyPress || next.xkey.keycode != ev->keycode
+    || CLEANMASK(next.xkey.state) != CLEANMASK(ev->state))
+      break;
+    XNextEvent(dpy, &next);
+    n++;
+  }
+  return n;
+}
+
+void
+killclient(const Arg *arg)
+{
+  if (!selmon->sel)
+    return;
+  if (!sendevent(selmon->sel->win, wmatom[WMDelete], NoEventMask, wmatom[WMDelete], CurrentTime, 0 , 0, 0)) {
+    XGrabServer(dpy);
     XSetErrorHandler(xerrordummy);
     XSetCloseDownMode(dpy, DestroyAll);
     XKillClient(dpy, selmon->sel->win);
-    XSync(dpy, False);
+    XSync(dpy, False); /* 同步点：窗口可能已经销毁，错误要在xerrordummy生效期间收到 */
     XSetErrorHandler(xerror);
     XUngrabServer(dpy);
   }
@@ -1603,9 +2725,15 @@ manage(Window w, XWindowAttributes *wa)
   Client *c, *t = NULL;
   Window trans = None;
   XWindowChanges wc;
+  int restored;
+  REQBEGIN;
 
   c = ecalloc(1, sizeof(Client));
   c->win = w;
+#ifdef XCB
+  prefetchprops(w);
+#endif
+  c->state = getstate(w);
   /* geometry */
   c->x = c->oldx = wa->x;
   c->y = c->oldy = wa->y;
@@ -1615,12 +2743,14 @@ manage(Window w, XWindowAttributes *wa)
   c->bw = borderpx; // 先设置bw，以便可以在applayrules中重定义，原先在下面的位置设置，如果提前有问题再行处理
 
   updatetitle(c);
-  if (XGetTransientForHint(dpy, w, &trans) && (t = wintoclient(trans))) {
+  updateclass(c);
+  if (gettransient(w, &trans) && (t = wintoclient(trans))) {
     c->mon = t->mon;
     c->tags = (t->tags & TAGMASK);
   } else {
     c->mon = selmon;
     applyrules(c);
+    placeclient(c);
   }
 
   if (c->x + WIDTH(c) > c->mon->wx + c->mon->ww)
@@ -1645,33 +2775,53 @@ manage(Window w, XWindowAttributes *wa)
     c->x = c->mon->wx + (c->mon->ww / 2 - WIDTH(c) / 2);
     c->y = c->mon->wy + (c->mon->wh / 2 - HEIGHT(c) / 2);
   }
+  restored = restoreclient(c);
 
   wc.border_width = c->bw;
   XConfigureWindow(dpy, w, CWBorderWidth, &wc);
   XSetWindowBorder(dpy, w, scheme[SchemeNorm][ColBorder].pixel);
+  c->borderpixel = scheme[SchemeNorm][ColBorder].pixel;
   configure(c); /* propagates border_width, if size doesn't change */
   updatewindowtype(c);
   updatesizehints(c);
   updatewmhints(c);
+#ifdef XSYNC
+  updatesynccounter(c);
+#endif
+#ifdef XCB
+  prefetchfree();
+#endif
   XSelectInput(dpy, w, EnterWindowMask|FocusChangeMask|PropertyChangeMask|StructureNotifyMask);
   grabbuttons(c, 0);
   if (!c->isfloating)
     c->isfloating = c->oldstate = trans != None || c->isfixed;
   if (c->isfloating)
     XRaiseWindow(dpy, c->win);
+  wintabput(c->win, WinClient, c);
   if (isappend(c)) {
     attachbottom(c);
   } else {
     attach(c);
   }
   attachstack(c);
-  XChangeProperty(dpy, root, netatom[NetClientList], XA_WINDOW, 32, PropModeAppend,
-    (unsigned char *) &(c->win), 1);
-  XMoveResizeWindow(dpy, c->win, c->x + 2 * sw, c->y, c->w, c->h); /* some windows require this */
+  ipcevent("manage %d 0x%lx %s", c->mon->num, c->win, c->class ? c->class : "");
+  if (bulk)
+    clientlistdirty = 1;
+  else
+    XChangeProperty(dpy, root, netatom[NetClientList], XA_WINDOW, 32, PropModeAppend,
+      (unsigned char *) &(c->win), 1);
+  /* 重启恢复的窗口还在原来的位置，不移出屏幕，提交时只有变化的部分 */
+  if (restored)
+    c->have = (Geom){ wa->x, wa->y, wa->width, wa->height, c->bw };
+  else {
+    XMoveResizeWindow(dpy, c->win, c->x + 2 * sw, c->y, c->w, c->h); /* some windows require this */
+    c->have = (Geom){ c->x + 2 * sw, c->y, c->w, c->h, c->bw };
+  }
+  c->want = c->have;
   if (!HIDDEN(c)) {
 		setclientstate(c, NormalState);
   }
-  if (c->mon == selmon) {
+  if (c->mon == selmon && !bulk) {
     unfocus(selmon->sel, 0);
   }
   setmonsel(c->mon, c);
@@ -1679,7 +2829,18 @@ manage(Window w, XWindowAttributes *wa)
 	if (!HIDDEN(c)) {
 		XMapWindow(dpy, c->win);
   }
-  focus(NULL);
+  if (!bulk)
+    focus(NULL);
+  REQEND(ReqManage);
+}
+
+void
+markdirty(Monitor *m, unsigned int bits)
+{
+  if (m)
+    m->dirty |= bits;
+  else for (m = mons; m; m = m->next)
+    m->dirty |= bits;
 }
 
 void
@@ -1760,7 +2921,7 @@ motionnotify(XEvent *e)
 void
 movemouse(const Arg *arg)
 {
-  int x, y, ocx, ocy, nx, ny;
+  int x, y, ocx, ocy, nx, ny, px, py, skipped = 0;
   Client *c;
   Monitor *m;
   XEvent ev;
@@ -1778,8 +2939,10 @@ movemouse(const Arg *arg)
     return;
   if (!getrootptr(&x, &y))
     return;
+  dragclient = c;
+  outlinebegin(c);
   do {
-    XMaskEvent(dpy, MOUSEMASK|ExposureMask|SubstructureRedirectMask, &ev);
+    XIfEvent(dpy, &ev, dragevent, NULL);
     switch(ev.type) {
     case ConfigureRequest:
     case Expose:
@@ -1787,12 +2950,26 @@ movemouse(const Arg *arg)
       handler[ev.type](&ev);
       break;
     case MotionNotify:
-      if ((ev.xmotion.time - lasttime) <= (1000 / 60))
-        continue;
-      lasttime = ev.xmotion.time;
+    case ButtonRelease:
+      // 按显示器刷新率更新，被跳过的最后位置在松开按键时补上
+      if (ev.type == MotionNotify) {
+        lastmotion(&ev);
+        if ((ev.xmotion.time - lasttime) < 1000 / selmon->refresh) {
+          skipped = 1;
+          continue;
+        }
+        lasttime = ev.xmotion.time;
+        px = ev.xmotion.x;
+        py = ev.xmotion.y;
+      } else if (skipped) {
+        px = ev.xbutton.x;
+        py = ev.xbutton.y;
+      } else
+        break;
+      skipped = 0;
 
-      nx = ocx + (ev.xmotion.x - x);
-      ny = ocy + (ev.xmotion.y - y);
+      nx = ocx + (px - x);
+      ny = ocy + (py - y);
       if (abs(selmon->wx - nx) < snap)
         nx = selmon->wx;
       else if (abs((selmon->wx + selmon->ww) - (nx + WIDTH(c))) < snap)
@@ -1808,7 +2985,13 @@ movemouse(const Arg *arg)
         resize(c, nx, ny, c->w, c->h, 1);
       break;
     }
+    flushdirty();
   } while (ev.type != ButtonRelease);
+  dragclient = NULL;
+  if (c == outlineclient)
+    outlineend(c); /* 提交时会发送ConfigureNotify */
+  else
+    configure(c);
   XUngrabPointer(dpy, CurrentTime);
   if ((m = recttomon(c->x, c->y, c->w, c->h)) != selmon) {
     sendmon(c, m);
@@ -1828,6 +3011,29 @@ nexttiled(Client *c)
   return c;
 }
 
+/* 开始以轮廓模式移动/调整c，之前的轮廓client先提交，c不使用轮廓模式时返回0 */
+int
+outlinebegin(Client *c)
+{
+  if (!c->outline)
+    return 0;
+  if (outlineclient && outlineclient != c)
+    outlineend(outlineclient);
+  outlineclient = c;
+  return 1;
+}
+
+/* 隐藏轮廓，c的几何在下一次flushdirty时一次性提交；也作为键盘操作的防抖定时器 */
+void
+outlineend(void *arg)
+{
+  if (!outlineclient || outlineclient != arg)
+    return;
+  outlineclient = NULL;
+  hideoutline();
+  geomdirty = 1;
+}
+
 void
 pop(Client *c)
 {
@@ -1837,6 +3043,80 @@ pop(Client *c)
   arrange(c->mon);
 }
 
+#ifdef XCB
+/* w的atom属性已经预取时返回1，*r为NULL表示属性不存在；没有预取时返回0，由调用者使用Xlib */
+int
+prefetched(Window w, Atom atom, xcb_get_property_reply_t **r)
+{
+  unsigned int i;
+
+  if (!prefetch.win || prefetch.win != w)
+    return 0;
+  for (i = 0; i < LENGTH(prefetch.atoms); i++)
+    if (prefetch.atoms[i] == atom) {
+      *r = prefetch.props[i];
+      return 1;
+    }
+  return 0;
+}
+
+void
+prefetchfree(void)
+{
+  unsigned int i;
+
+  for (i = 0; i < LENGTH(prefetch.props); i++) {
+    free(prefetch.props[i]);
+    prefetch.props[i] = NULL;
+  }
+  prefetch.win = None;
+}
+
+/* 一次发出manage需要的所有属性请求再统一取回，代替逐个属性的round trip */
+void
+prefetchprops(Window w)
+{
+  xcb_get_property_cookie_t cookies[LENGTH(prefetch.atoms)];
+  xcb_get_property_reply_t *r;
+  xcb_generic_error_t *e;
+  unsigned int i;
+  Atom atoms[LENGTH(prefetch.atoms)] = {
+    netatom[NetWMName], XA_WM_NAME, XA_WM_CLASS, XA_WM_TRANSIENT_FOR,
+    XA_WM_NORMAL_HINTS, XA_WM_HINTS, netatom[NetWMState], netatom[NetWMWindowType],
+    wmatom[WMState], wmatom[WMProtocols], netatom[NetWMSyncRequestCounter]
+  };
+
+  prefetchfree();
+  for (i = 0; i < LENGTH(atoms); i++)
+    cookies[i] = xcb_get_property(xcb, 0, w, atoms[i], XCB_GET_PROPERTY_TYPE_ANY, 0, 256);
+  for (i = 0; i < LENGTH(atoms); i++) {
+    e = NULL;
+    r = xcb_get_property_reply(xcb, cookies[i], &e);
+    free(e);
+    if (r && r->type == XCB_NONE) {
+      free(r);
+      r = NULL;
+    }
+    /* 超过256个long（如很长的标题）时重新取回完整的属性，避免截断UTF-8字符 */
+    if (r && r->bytes_after) {
+      cookies[i] = xcb_get_property(xcb, 0, w, atoms[i], XCB_GET_PROPERTY_TYPE_ANY, 0,
+                                    256 + (r->bytes_after + 3) / 4);
+      free(r);
+      e = NULL;
+      r = xcb_get_property_reply(xcb, cookies[i], &e);
+      free(e);
+      if (r && r->type == XCB_NONE) {
+        free(r);
+        r = NULL;
+      }
+    }
+    prefetch.atoms[i] = atoms[i];
+    prefetch.props[i] = r;
+  }
+  prefetch.win = w;
+}
+#endif /* XCB */
+
 void
 propertynotify(XEvent *e)
 {
@@ -1854,10 +3134,8 @@ propertynotify(XEvent *e)
     resizebarwin(selmon);
     updatesystray();
   }
-  if ((ev->window == root) && (ev->atom == XA_WM_NAME)) {
-    if (!fake_signal())
-      updatestatus();
-  }
+  if ((ev->window == root) && (ev->atom == XA_WM_NAME))
+    updatestatus();
   else if (ev->state == PropertyDelete)
     return; /* ignore */
   else if ((c = wintoclient(ev->window))) {
@@ -1875,17 +3153,70 @@ propertynotify(XEvent *e)
       updatewmhints(c);
       drawbars();
       break;
+    case XA_WM_CLASS:
+      updateclass(c);
+      updatetaglabels(c->mon);
+      markdirty(c->mon, DirtyBar);
+      break;
     }
     if (ev->atom == XA_WM_NAME || ev->atom == netatom[NetWMName]) {
       updatetitle(c);
+      ipcevent("title 0x%lx %s", c->win, c->name);
       if (c == c->mon->sel)
-        drawbar(c->mon);
+        markdirty(c->mon, DirtyBar);
     }
     if (ev->atom == netatom[NetWMWindowType])
       updatewindowtype(c);
+    else if (ev->atom == wmatom[WMState])
+      c->state = getstate(c->win);
+#ifdef XSYNC
+    /* client可能在map之后才声明_NET_WM_SYNC_REQUEST或设置counter */
+    else if (ev->atom == wmatom[WMProtocols] || ev->atom == netatom[NetWMSyncRequestCounter])
+      updatesynccounter(c);
+#endif
   }
 }
 
+/* 与上一批事件结束时比较，向订阅者推送focus、tags、layout和monitor的变化 */
+void
+publishevents(void)
+{
+  Monitor *m;
+  Window sel;
+
+  for (m = mons; m; m = m->next) {
+    if (m->tagset[m->seltags] != m->evtags) {
+      m->evtags = m->tagset[m->seltags];
+      ipcevent("tags %d %u", m->num, m->evtags);
+    }
+    if (m->lt[m->sellt] != m->evlt) {
+      m->evlt = m->lt[m->sellt];
+      ipcevent("layout %d %s", m->num, m->ltsymbol);
+    }
+    sel = m->sel ? m->sel->win : None;
+    if (sel != m->evsel) {
+      m->evsel = sel;
+      ipcevent("focus %d 0x%lx", m->num, sel);
+    }
+  }
+  if (selmon && selmon->num != evselmon) {
+    evselmon = selmon->num;
+    ipcevent("monitor %d", evselmon);
+  }
+}
+
+/* 聚焦状态有变化时推迟写入statusdir，连续的变化停止statusdelay ms后只写一次 */
+void
+publishstatus(void)
+{
+  if (!statusdir[0] || !selmon)
+    return;
+  if (selmon->num != published.selmon
+  || (selmon->sel ? selmon->sel->win : None) != published.selwin
+  || selmon->tagset[selmon->seltags] != published.seltags)
+    settimer(statusdelay, savestatus, NULL);
+}
+
 void
 quit(const Arg *arg)
 {
@@ -1899,7 +3230,534 @@ quit(const Arg *arg)
 		}
 	}
 
-  running = 0;
+  running = 0;
+}
+
+/* 退出主循环后保存状态并重新exec dwm，窗口保持原样，新进程在scan时恢复 */
+void
+restart(const Arg *arg)
+{
+  if (selmon->isoverview)
+    toggleoverview(NULL);
+  restarting = 1;
+  running = 0;
+}
+
+/* 把monitor、pertag和client状态写入root窗口的_DWM_STATE */
+void
+savestate(void)
+{
+  Monitor *m;
+  Client *c, *i;
+  unsigned long n = 4, nmons = 0, nclients = 0;
+  unsigned int t;
+  long *buf, *r;
+
+  for (m = mons; m; m = m->next, nmons++)
+    for (c = m->clients; c; c = c->next)
+      nclients++;
+  buf = ecalloc(4 + nmons * MONSTATE + nclients * CLIENTSTATE, sizeof(long));
+  buf[0] = STATEVERSION;
+  buf[1] = LENGTH(tags);
+  buf[2] = nmons;
+  buf[3] = nclients;
+  for (m = mons; m; m = m->next) {
+    r = buf + n;
+    r[0] = m->num;
+    r[1] = m->seltags;
+    r[2] = m->tagset[0];
+    r[3] = m->tagset[1];
+    r[4] = m->pertag->curtag | m->pertag->prevtag << 16;
+    for (t = 0; t <= LENGTH(tags); t++) {
+      r[5 + 6 * t] = m->pertag->nmasters[t];
+      r[6 + 6 * t] = m->pertag->mfacts[t] * 10000;
+      r[7 + 6 * t] = m->pertag->sellts[t];
+      r[8 + 6 * t] = m->pertag->ltidxs[t][0] - layouts;
+      r[9 + 6 * t] = m->pertag->ltidxs[t][1] - layouts;
+      r[10 + 6 * t] = m->pertag->showbars[t];
+    }
+    n += MONSTATE;
+  }
+  for (m = mons; m; m = m->next)
+    for (c = m->clients; c; c = c->next) {
+      r = buf + n;
+      r[0] = c->win;
+      r[1] = m->num;
+      r[2] = c->tags;
+      /* 全屏的client保存全屏之前的几何，新进程通过_NET_WM_STATE重新进入全屏 */
+      r[3] = (c->isfullscreen ? c->oldstate : c->isfloating) | (c->hid ? 2 : 0);
+      r[4] = c->isfullscreen ? c->oldx : c->x;
+      r[5] = c->isfullscreen ? c->oldy : c->y;
+      r[6] = c->isfullscreen ? c->oldw : c->w;
+      r[7] = c->isfullscreen ? c->oldh : c->h;
+      n += CLIENTSTATE;
+    }
+  XChangeProperty(dpy, root, wmatom[DWMState], XA_CARDINAL, 32, PropModeReplace,
+    (unsigned char *)buf, n);
+  free(buf);
+  /* 托盘图标放回root，新的systray取得selection后它们会重新嵌入 */
+  if (showsystray)
+    for (i = systray->icons; i; i = i->next) {
+      XUnmapWindow(dpy, i->win);
+      XReparentWindow(dpy, i->win, root, 0, 0);
+      XRemoveFromSaveSet(dpy, i->win);
+    }
+}
+
+/* 读取并删除_DWM_STATE，恢复monitor和pertag状态，client记录留给scan中的restoreclient */
+void
+loadstate(void)
+{
+  Atom type;
+  int format;
+  unsigned long n, after, i, nmons, nclients;
+  unsigned int t;
+  long *p = NULL, *r;
+  Monitor *m;
+  Pertag *pt;
+
+  if (XGetWindowProperty(dpy, root, wmatom[DWMState], 0L, 1L << 20, True, XA_CARDINAL,
+      &type, &format, &n, &after, (unsigned char **)&p) != Success || !p)
+    return;
+  if (n < 4 || p[0] != STATEVERSION || p[1] != LENGTH(tags)
+  || n != 4 + (nmons = p[2]) * MONSTATE + (nclients = p[3]) * CLIENTSTATE) {
+    XFree(p);
+    return;
+  }
+  for (i = 0; i < nmons; i++) {
+    r = p + 4 + i * MONSTATE;
+    for (m = mons; m && m->num != r[0]; m = m->next);
+    if (!m)
+      continue;
+    pt = m->pertag;
+    m->seltags = r[1] & 1;
+    m->tagset[0] = r[2];
+    m->tagset[1] = r[3];
+    pt->curtag = (r[4] & 0xffff) % (LENGTH(tags) + 1);
+    pt->prevtag = (r[4] >> 16) % (LENGTH(tags) + 1);
+    for (t = 0; t <= LENGTH(tags); t++) {
+      pt->nmasters[t] = r[5 + 6 * t];
+      pt->mfacts[t] = r[6 + 6 * t] / 10000.0;
+      pt->sellts[t] = r[7 + 6 * t] & 1;
+      pt->ltidxs[t][0] = &layouts[r[8 + 6 * t] >= 0 && r[8 + 6 * t] < LENGTH(layouts) ? r[8 + 6 * t] : 0];
+      pt->ltidxs[t][1] = &layouts[r[9 + 6 * t] >= 0 && r[9 + 6 * t] < LENGTH(layouts) ? r[9 + 6 * t] : 0];
+      pt->showbars[t] = r[10 + 6 * t];
+    }
+    applypertag(m);
+  }
+  restorestate = p;
+  restoreclients = p + 4 + nmons * MONSTATE;
+  nrestoreclients = nclients;
+}
+
+/* 按pertag中当前tag的设置更新m，pertag被整体替换后调用 */
+void
+applypertag(Monitor *m)
+{
+  Pertag *pt = m->pertag;
+
+  m->nmaster = pt->nmasters[pt->curtag];
+  m->mfact = pt->mfacts[pt->curtag];
+  m->sellt = pt->sellts[pt->curtag];
+  m->lt[0] = pt->ltidxs[pt->curtag][0];
+  m->lt[1] = pt->ltidxs[pt->curtag][1];
+  if (m->showbar != pt->showbars[pt->curtag]) {
+    m->showbar = pt->showbars[pt->curtag];
+    updatebarpos(m);
+    resizebarwin(m);
+  }
+  updatetaglabels(m);
+  arrange(m);
+}
+
+/* 重启前保存过c时恢复它的monitor、tags、浮动状态和几何，返回1 */
+int
+restoreclient(Client *c)
+{
+  unsigned long i;
+  long *r;
+  Monitor *m;
+
+  for (i = 0; i < nrestoreclients; i++) {
+    r = restoreclients + i * CLIENTSTATE;
+    if ((Window)r[0] != c->win)
+      continue;
+    for (m = mons; m && m->num != r[1]; m = m->next);
+    if (m)
+      c->mon = m;
+    c->tags = r[2];
+    c->isfloating = r[3] & 1;
+    c->hid = (r[3] & 2) ? 1 : 0;
+    c->x = (int)r[4];
+    c->y = (int)r[5];
+    c->w = r[6];
+    c->h = r[7];
+    return 1;
+  }
+  return 0;
+}
+
+/* 推迟到主循环执行，按键触发时arg还指向将被释放的ckeys */
+void
+reload(const Arg *arg)
+{
+  settimer(0, loadconfig, NULL);
+}
+
+/* 重新读取运行时配置并应用到已有的client，不重新manage */
+void
+loadconfig(void *arg)
+{
+  const char *prev[LENGTH(colors)][3];
+  Client *c, **cs = NULL, *old = NULL, nc;
+  Monitor *m;
+  unsigned int i, n = 0;
+
+  /* 先用旧规则计算每个client的结果，新旧结果不同的才重新应用规则，tags为规则指定的原始值 */
+  for (m = mons; m; m = m->next)
+    for (c = m->clients; c; c = c->next)
+      n++;
+  if (n) {
+    cs = ecalloc(n, sizeof(Client *));
+    old = ecalloc(n, sizeof(Client));
+  }
+  for (i = 0, m = mons; m; m = m->next)
+    for (c = m->clients; c; c = c->next, i++) {
+      cs[i] = c;
+      old[i] = *c;
+      old[i].tags = matchrules(&old[i]);
+    }
+  memcpy(prev, ccolors, sizeof prev);
+  readconfig();
+  for (i = 0; i < n; i++) {
+    c = cs[i];
+    nc = *c;
+    nc.tags = matchrules(&nc);
+    if (nc.tags == old[i].tags && nc.isfloating == old[i].isfloating && nc.bw == old[i].bw
+    && nc.fixrender == old[i].fixrender && nc.outline == old[i].outline && nc.mon == old[i].mon
+    && nc.x == old[i].x && nc.y == old[i].y && nc.w == old[i].w && nc.h == old[i].h)
+      continue;
+    /* 只改变新旧规则结果不同的字段，保留用户手动做的修改 */
+    if (nc.mon != old[i].mon)
+      sendmon(c, nc.mon);
+    /* 规则不再指定tags时保留c->tags，不能像manage那样退回到当前查看的tags */
+    if (nc.tags && (nc.tags != old[i].tags || nc.mon != old[i].mon))
+      c->tags = nc.tags;
+    if (nc.fixrender != old[i].fixrender)
+      c->fixrender = nc.fixrender;
+    if (nc.outline != old[i].outline)
+      c->outline = nc.outline;
+    if (nc.bw != old[i].bw) {
+      if (c->isfullscreen)
+        c->oldbw = nc.bw;
+      else
+        c->bw = nc.bw;
+    }
+    if (!c->isfullscreen) {
+      if (nc.isfloating != old[i].isfloating)
+        c->isfloating = nc.isfloating || c->isfixed;
+      if (c->isfloating && (nc.x != old[i].x || nc.y != old[i].y || nc.w != old[i].w || nc.h != old[i].h))
+        resize(c, nc.x, nc.y, nc.w, nc.h, 0);
+    }
+    markdirty(c->mon, DirtyLayout);
+  }
+  free(cs);
+  free(old);
+  /* tagnamemap可能变化，重新解析标签上的名称 */
+  for (m = mons; m; m = m->next) {
+    for (c = m->clients; c; c = c->next)
+      c->icon = gettagdisplayname(c->class);
+    updatetaglabels(m);
+    markdirty(m, DirtyBar);
+  }
+  if (memcmp(prev, ccolors, sizeof prev)) {
+    for (i = 0; i < LENGTH(colors); i++) {
+      free(scheme[i]);
+      scheme[i] = drw_scm_create(drw, ccolors[i], alphas[i], 3);
+    }
+    for (m = mons; m; m = m->next) {
+      XSetWindowBackground(dpy, m->barwin, scheme[SchemeNorm][ColBg].pixel);
+      for (c = m->clients; c; c = c->next)
+        setborderpixel(c, scheme[c == selmon->sel ? SchemeSel : SchemeNorm][ColBorder].pixel);
+    }
+    for (i = 0; i < LENGTH(outlinewins); i++)
+      if (outlinewins[i])
+        XSetWindowBackground(dpy, outlinewins[i], scheme[SchemeSel][ColBorder].pixel);
+    if (showsystray && systray)
+      XSetWindowBackground(dpy, systray->win, scheme[SchemeNorm][ColBg].pixel);
+  }
+  grabkeys();
+}
+
+/* 运行时配置：$DWM_CONFIG或~/.config/dwm/dwmrc，文件中出现的段替换config.h中对应的表
+ *   key MOD[+MOD] KEYSYM command [arg]   command为commands中的名称，或spawn/togglescratch加shell命令
+ *   rule class instance title [tags isfloating monitor hideborder fixrender outline x y width height]
+ *   tagname class icon
+ *   color norm|sel|hid fg bg border
+ * 字段可以用双引号包含空格，"-"表示NULL或保持不变，#开始注释 */
+void
+readconfig(void)
+{
+  static const char *schemenames[] = { [SchemeNorm] = "norm", [SchemeSel] = "sel", [SchemeHid] = "hid" };
+  FILE *f;
+  char *buf = NULL, *line, *next, *s, *t, *end;
+  const char *err, *fields[3];
+  size_t size = 0, nlines = 0, nk = 0, nr = 0, nt = 0;
+  const char **argvs, **a, *v;
+  Key *k;
+  Rule *r;
+  TagMapEntry *tm;
+  Arg arg;
+  KeySym sym;
+  void (*func)(const Arg *);
+  long vals[10];
+  int lineno, mod, i, j;
+  XftColor xc;
+
+  memcpy(ccolors, colors, sizeof ccolors);
+  if (configpath[0] && (f = fopen(configpath, "r"))) {
+    if (getdelim(&buf, &size, '\0', f) > 0)
+      for (s = buf, nlines = 1; *s; s++)
+        nlines += *s == '\n';
+    fclose(f);
+  }
+  /* 按行数分配，最多每行一项 */
+  k = nlines ? ecalloc(nlines, sizeof(Key)) : NULL;
+  argvs = nlines ? ecalloc(nlines * 4, sizeof(char *)) : NULL;
+  r = nlines ? ecalloc(nlines, sizeof(Rule)) : NULL;
+  tm = nlines ? ecalloc(nlines, sizeof(TagMapEntry)) : NULL;
+  for (line = nlines ? buf : NULL, lineno = 1; line; line = next, lineno++) {
+    if ((next = strchr(line, '\n')))
+      *next++ = '\0';
+    for (end = line + strlen(line); end > line && isspace((unsigned char)end[-1]); *--end = '\0');
+    s = line;
+    err = NULL;
+    if (!(t = parsetoken(&s)))
+      continue;
+    if (!strcmp(t, "key")) {
+      func = NULL;
+      arg.v = NULL;
+      if (!(t = parsetoken(&s)) || (mod = parsemods(t)) < 0)
+        err = "bad modifier";
+      else if (!(t = parsetoken(&s)) || (sym = XStringToKeysym(t)) == NoSymbol)
+        err = "bad keysym";
+      else if (!(t = parsetoken(&s)))
+        err = "missing command";
+      else if (!strcmp(t, "spawn") || !strcmp(t, "togglescratch")) {
+        while (isspace((unsigned char)*s))
+          s++;
+        if (!*s)
+          err = "missing shell command";
+        a = &argvs[nk * 4];
+        a[0] = "/bin/sh";
+        a[1] = "-c";
+        a[2] = intern(s);
+        func = !strcmp(t, "spawn") ? spawn : togglescratch;
+        arg.v = a;
+      } else {
+        for (i = 0; i < LENGTH(commands) && strcmp(t, commands[i].name); i++);
+        if (i == LENGTH(commands))
+          err = "unknown command";
+        else if (!(err = parsecmdarg(commands[i].argtype, parsetoken(&s), &arg)))
+          func = commands[i].func;
+      }
+      if (!err) {
+        Key key = { mod, sym, func, arg };
+        memcpy(&k[nk++], &key, sizeof key);
+      }
+    } else if (!strcmp(t, "rule")) {
+      long def[LENGTH(vals)] = { 0, 0, -1, 0, 0, 0, 0, 0, -1, -1 };
+
+      memcpy(vals, def, sizeof vals);
+      for (i = 0; i < 3; i++)
+        fields[i] = (t = parsetoken(&s)) && strcmp(t, "-") ? intern(t) : NULL;
+      for (i = 0; i < LENGTH(vals) && !err && (t = parsetoken(&s)); i++) {
+        vals[i] = strtol(t, &end, 0);
+        if (*end)
+          err = "bad number";
+      }
+      if (!err) {
+        r[nr].class = fields[0];
+        r[nr].instance = fields[1];
+        r[nr].title = fields[2];
+        r[nr].tags = vals[0];
+        r[nr].isfloating = vals[1];
+        r[nr].monitor = vals[2];
+        r[nr].hideborder = vals[3];
+        r[nr].fixrender = vals[4];
+        r[nr].outline = vals[5];
+        r[nr].x = vals[6];
+        r[nr].y = vals[7];
+        r[nr].width = vals[8];
+        r[nr].height = vals[9];
+        nr++;
+      }
+    } else if (!strcmp(t, "tagname")) {
+      if (!(t = parsetoken(&s)) || !(v = parsetoken(&s)))
+        err = "expected class and icon";
+      else {
+        tm[nt].key = intern(t);
+        tm[nt].val = intern(v);
+        nt++;
+      }
+    } else if (!strcmp(t, "color")) {
+      t = parsetoken(&s);
+      for (i = 0; i < LENGTH(schemenames) && (!t || strcmp(t, schemenames[i])); i++);
+      if (i == LENGTH(schemenames))
+        err = "unknown scheme";
+      /* 无法分配的颜色会使drw_clr_create退出，先验证 */
+      for (j = 0; j < 3 && !err && (t = parsetoken(&s)); j++) {
+        if (!strcmp(t, "-"))
+          continue;
+        if (!XftColorAllocName(dpy, visual, cmap, t, &xc))
+          err = "bad color";
+        else {
+          XftColorFree(dpy, visual, cmap, &xc);
+          ccolors[i][j] = intern(t);
+        }
+      }
+    } else
+      err = "unknown keyword";
+    if (err)
+      fprintf(stderr, "dwm: %s:%d: %s\n", configpath, lineno, err);
+  }
+  free(buf);
+  /* 表中的字符串都是驻留的，c->icon等引用在替换后仍然有效 */
+  free(cfgkeys);
+  free(cfgargvs);
+  free(cfgrules);
+  free(cfgtagmap);
+  if (!nk) {
+    free(k);
+    free(argvs);
+    k = NULL;
+    argvs = NULL;
+  }
+  if (!nr) {
+    free(r);
+    r = NULL;
+  }
+  if (!nt) {
+    free(tm);
+    tm = NULL;
+  }
+  cfgkeys = k;
+  cfgargvs = argvs;
+  cfgrules = r;
+  cfgtagmap = tm;
+  ckeys = nk ? cfgkeys : keys;
+  nckeys = nk ? nk : LENGTH(keys);
+  crules = nr ? cfgrules : rules;
+  ncrules = nr ? nr : LENGTH(rules);
+  ctagnamemap = nt ? cfgtagmap : tagnamemap;
+  nctagnamemap = nt ? nt : LENGTH(tagnamemap);
+}
+
+/* 取出下一个以空白分隔的字段，双引号内可以包含空白，行尾或#注释处返回NULL */
+char *
+parsetoken(char **s)
+{
+  char *p = *s, *t;
+
+  while (isspace((unsigned char)*p))
+    p++;
+  if (!*p || *p == '#') {
+    *s = p;
+    return NULL;
+  }
+  if (*p == '"')
+    for (t = ++p; *p && *p != '"'; p++);
+  else
+    for (t = p; *p && !isspace((unsigned char)*p); p++);
+  if (*p)
+    *p++ = '\0';
+  *s = p;
+  return t;
+}
+
+/* 解析Mod4+Shift形式的修饰键，无效时返回-1 */
+int
+parsemods(char *s)
+{
+  static const struct {
+    const char *name;
+    unsigned int mask;
+  } mods[] = {
+    { "None", NOMODKEY }, { "MODKEY", MODKEY }, { "Shift", ShiftMask }, { "Lock", LockMask },
+    { "Control", ControlMask }, { "Ctrl", ControlMask }, { "Mod1", Mod1Mask }, { "Mod2", Mod2Mask },
+    { "Mod3", Mod3Mask }, { "Mod4", Mod4Mask }, { "Mod5", Mod5Mask },
+  };
+  unsigned int i, mask = 0;
+  char *t;
+
+  for (t = strtok(s, "+|"); t; t = strtok(NULL, "+|")) {
+    for (i = 0; i < LENGTH(mods) && strcmp(t, mods[i].name); i++);
+    if (i == LENGTH(mods))
+      return -1;
+    mask |= mods[i].mask;
+  }
+  return mask;
+}
+
+// 配置文件路径，监视所在目录以便编辑器用rename替换文件时也能收到通知
+void
+setupconfig(void)
+{
+  const char *p, *home;
+  char dir[sizeof configpath], *slash;
+
+  if ((p = getenv("DWM_CONFIG")) && *p)
+    snprintf(configpath, sizeof configpath, "%s", p);
+  else if ((p = getenv("XDG_CONFIG_HOME")) && *p)
+    snprintf(configpath, sizeof configpath, "%s/dwm/dwmrc", p);
+  else if ((home = getenv("HOME")))
+    snprintf(configpath, sizeof configpath, "%s/.config/dwm/dwmrc", home);
+  readconfig();
+  if (!configpath[0] || !(slash = strrchr(configpath, '/')))
+    return;
+  snprintf(dir, sizeof dir, "%.*s", (int)(slash - configpath), configpath);
+  if ((configfd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC)) < 0)
+    return;
+  if (inotify_add_watch(configfd, dir[0] ? dir : "/", IN_CLOSE_WRITE|IN_MOVED_TO|IN_DELETE) < 0
+  || watchfd(configfd, POLLIN, configwatch) < 0) {
+    close(configfd);
+    configfd = -1;
+  }
+}
+
+/* 配置文件被写入、替换或删除时重新加载，短时间内的多次事件合并为一次 */
+void
+configwatch(int fd, short revents)
+{
+  union {
+    struct inotify_event ev; /* 保证buf按inotify_event对齐 */
+    char buf[4096];
+  } u;
+  const char *name = strrchr(configpath, '/') + 1;
+  struct inotify_event *ev;
+  ssize_t n;
+  char *p;
+
+  while ((n = read(fd, u.buf, sizeof u.buf)) > 0)
+    for (p = u.buf; p < u.buf + n; p += sizeof(struct inotify_event) + ev->len) {
+      ev = (struct inotify_event *)p;
+      if (ev->len && !strcmp(ev->name, name))
+        settimer(100, loadconfig, NULL);
+    }
+}
+
+/* 跳过队列中连续的MotionNotify，只保留最后一个 */
+void
+lastmotion(XEvent *ev)
+{
+  XEvent next;
+
+  while (XEventsQueued(dpy, QueuedAfterReading)) {
+    XPeekEvent(dpy, &next);
+    if (next.type != MotionNotify)
+      break;
+    XNextEvent(dpy, ev);
+  }
 }
 
 Monitor *
@@ -1926,6 +3784,7 @@ removesystrayicon(Client *i)
   for (ii = &systray->icons; *ii && *ii != i; ii = &(*ii)->next);
   if (ii)
     *ii = i->next;
+  wintabdel(i->win);
   free(i);
 }
 
@@ -1936,9 +3795,11 @@ resize(Client *c, int x, int y, int w, int h, int interact)
   if (applysizehints(c, &x, &y, &w, &h, interact)) {
     if (c->fixrender) {
       // 对于一些特殊的应用，例如xmind，存在resize后无法刷新的情况，下面的多次操作可以使这些应用的视图刷新生效，在找到真正的解决办法之前这会是一种无可奈何的方案
+      // 先提交偏移1px的几何，25ms后由定时器恢复，期间重复的resize只会推迟恢复
       resizeclient(c, x+1, y+1, w, h);
-      usleep(25000);
-      resizeclient(c, x, y, w, h);
+      c->fixx = x; c->fixy = y; c->fixw = w; c->fixh = h;
+      c->fixpending = 1;
+      settimer(25, fixrender, c);
     } else {
       resizeclient(c, x, y, w, h);
     }
@@ -1953,34 +3814,39 @@ resizebarwin(Monitor *m) {
   XMoveResizeWindow(dpy, m->barwin, m->wx, m->by, w, bh);
 }
 
+/* 只记录目标几何，请求由flushdirty中的commitgeoms统一发送 */
 void
 resizeclient(Client *c, int x, int y, int w, int h)
 {
-  XWindowChanges wc;
-
-  c->oldx = c->x; c->x = wc.x = x;
-  c->oldy = c->y; c->y = wc.y = y;
-  c->oldw = c->w; c->w = wc.width = w;
-  c->oldh = c->h; c->h = wc.height = h;
-  wc.border_width = c->bw;
+  c->oldx = c->x; c->x = x;
+  c->oldy = c->y; c->y = y;
+  c->oldw = c->w; c->w = w;
+  c->oldh = c->h; c->h = h;
+  c->want.bw = c->bw;
   if (solitary(c)) {
-    c->w = wc.width += c->bw * 2;
-    c->h = wc.height += c->bw * 2;
-    wc.border_width = 0;
+    c->w += c->bw * 2;
+    c->h += c->bw * 2;
+    c->want.bw = 0;
   }
-  XConfigureWindow(dpy, c->win, CWX|CWY|CWWidth|CWHeight|CWBorderWidth, &wc);
-  configure(c);
-  XSync(dpy, False);
+  c->want.x = c->x;
+  c->want.y = c->y;
+  c->want.w = c->w;
+  c->want.h = c->h;
+  c->configpending = 1;
+  geomdirty = 1;
 }
 
 void
 resizemouse(const Arg *arg)
 {
-  int ocx, ocy, nw, nh;
+  int ocx, ocy, nw, nh, px, py, skipped = 0;
   Client *c;
   Monitor *m;
   XEvent ev;
   Time lasttime = 0;
+#ifdef XSYNC
+  XEvent last;
+#endif
 
   if (!(c = selmon->sel))
     return;
@@ -1993,8 +3859,23 @@ resizemouse(const Arg *arg)
     None, cursor[CurResize]->cursor, CurrentTime) != GrabSuccess)
     return;
   XWarpPointer(dpy, None, c->win, 0, 0, 0, 0, c->w + c->bw - 1, c->h + c->bw - 1);
+#ifdef XSYNC
+  syncbegin(c);
+#endif
+  outlinebegin(c);
   do {
-    XMaskEvent(dpy, MOUSEMASK|ExposureMask|SubstructureRedirectMask, &ev);
+    XIfEvent(dpy, &ev, dragevent, NULL);
+#ifdef XSYNC
+    /* client已经按上一个尺寸重绘完成，补上等待期间跳过的位置 */
+    if (syncevbase >= 0 && ev.type == syncevbase + XSyncAlarmNotify) {
+      if (syncclient)
+        syncclient->syncwaiting = 0;
+      if (!skipped)
+        continue;
+      ev = last;
+      lasttime = 0;
+    }
+#endif
     switch(ev.type) {
     case ConfigureRequest:
     case Expose:
@@ -2002,12 +3883,32 @@ resizemouse(const Arg *arg)
       handler[ev.type](&ev);
       break;
     case MotionNotify:
-      if ((ev.xmotion.time - lasttime) <= (1000 / 60))
-        continue;
-      lasttime = ev.xmotion.time;
+    case ButtonRelease:
+      if (ev.type == MotionNotify) {
+        lastmotion(&ev);
+        if ((ev.xmotion.time - lasttime) < 1000 / selmon->refresh
+#ifdef XSYNC
+        || syncblocked(c)
+#endif
+        ) {
+          skipped = 1;
+#ifdef XSYNC
+          last = ev;
+#endif
+          continue;
+        }
+        lasttime = ev.xmotion.time;
+        px = ev.xmotion.x;
+        py = ev.xmotion.y;
+      } else if (skipped) {
+        px = ev.xbutton.x;
+        py = ev.xbutton.y;
+      } else
+        break;
+      skipped = 0;
 
-      nw = MAX(ev.xmotion.x - ocx - 2 * c->bw + 1, 1);
-      nh = MAX(ev.xmotion.y - ocy - 2 * c->bw + 1, 1);
+      nw = MAX(px - ocx - 2 * c->bw + 1, 1);
+      nh = MAX(py - ocy - 2 * c->bw + 1, 1);
       if (c->mon->wx + nw >= selmon->wx && c->mon->wx + nw <= selmon->wx + selmon->ww
       && c->mon->wy + nh >= selmon->wy && c->mon->wy + nh <= selmon->wy + selmon->wh)
       {
@@ -2019,7 +3920,12 @@ resizemouse(const Arg *arg)
         resize(c, c->x, c->y, nw, nh, 1);
       break;
     }
+    flushdirty();
   } while (ev.type != ButtonRelease);
+#ifdef XSYNC
+  syncend();
+#endif
+  outlineend(c);
   XWarpPointer(dpy, None, c->win, 0, 0, 0, 0, c->w + c->bw - 1, c->h + c->bw - 1);
   XUngrabPointer(dpy, CurrentTime);
   while (XCheckMaskEvent(dpy, EnterWindowMask, &ev));
@@ -2045,12 +3951,17 @@ resizerequest(XEvent *e)
 
 void
 restack(Monitor *m)
+{
+  markdirty(m, DirtyStack|DirtyBar);
+}
+
+void
+restackmon(Monitor *m)
 {
   Client *c;
   XEvent ev;
   XWindowChanges wc;
 
-  drawbar(m);
   if (!m->sel)
     return;
   if (m->sel->isfloating || !m->lt[m->sellt]->arrange) // 当前client是浮动的，或布局是浮动的，将当前窗口置顶
@@ -2066,6 +3977,7 @@ restack(Monitor *m)
         wc.sibling = c->win;
       }
   }
+  /* 每批事件中唯一的同步点：等commitgeoms和上面的restack生效后再丢弃它们产生的EnterNotify */
   XSync(dpy, False);
   while (XCheckMaskEvent(dpy, EnterWindowMask, &ev));
 }
@@ -2074,11 +3986,77 @@ void
 run(void)
 {
   XEvent ev;
+  int i, timeout;
+#ifdef STATS
+  long long t;
+
+  statsince = getus();
+#endif
   /* main event loop */
   XSync(dpy, False);
-  while (running && !XNextEvent(dpy, &ev))
-    if (handler[ev.type])
-      handler[ev.type](&ev); /* call handler */
+  flushdirty();
+  while (running) {
+    // 先处理完已经排队的事件，再统一执行一次布局和重绘
+    while (running && XPending(dpy)) {
+      XNextEvent(dpy, &ev);
+#ifdef STATS
+      t = getus();
+#endif
+      /* 扩展事件（如XSync的alarm）的type超出handler的范围 */
+      if (ev.type < LASTEvent && handler[ev.type])
+        handler[ev.type](&ev); /* call handler */
+#ifdef STATS
+      if (ev.type < LASTEvent)
+        statrecord(&evstats[ev.type], t, ev.xany.window);
+#endif
+    }
+    flushdirty();
+    /* flushdirty中的XSync可能又读入了新的事件 */
+    if (!running || XPending(dpy))
+      continue;
+    if ((timeout = runtimers()) == 0)
+      continue;
+    if (poll(watchfds, nwatchfds, timeout) < 0) {
+      if (errno == EINTR)
+        continue;
+      die("dwm: poll:");
+    }
+    for (i = 0; i < nwatchfds; i++)
+      if (watchfds[i].fd >= 0 && watchfds[i].revents && watchfuncs[i]) {
+#ifdef STATS
+        t = getus();
+#endif
+        watchfuncs[i](watchfds[i].fd, watchfds[i].revents);
+#ifdef STATS
+        statrecord(&opstats[StatWatch], t, None);
+#endif
+      }
+    flushdirty();
+  }
+}
+
+/* 执行到期的定时器，返回距下一个定时器的ms数，没有定时器时返回-1 */
+int
+runtimers(void)
+{
+  long long now = getms(), next = -1;
+  unsigned int i;
+  int ran = 0;
+
+  for (i = 0; i < LENGTH(timers); i++) {
+    if (!timers[i].when)
+      continue;
+    if (timers[i].when <= now) {
+      timers[i].when = 0;
+      timers[i].func(timers[i].arg);
+      ran = 1;
+    } else if (next < 0 || timers[i].when < next)
+      next = timers[i].when;
+  }
+  /* 定时器可能修改了布局，先回到主循环执行flushdirty */
+  if (ran)
+    return 0;
+  return next < 0 ? -1 : next - now;
 }
 
 void
@@ -2163,28 +4141,95 @@ scan(void)
 {
   unsigned int i, num;
   Window d1, d2, *wins = NULL;
-  XWindowAttributes wa;
+  XWindowAttributes *wa;
+  char *kind;
 
   if (XQueryTree(dpy, root, &d1, &d2, &wins, &num)) {
-    for (i = 0; i < num; i++) {
-      if (!XGetWindowAttributes(dpy, wins[i], &wa)
-      || wa.override_redirect || XGetTransientForHint(dpy, wins[i], &d1))
-        continue;
-      if (wa.map_state == IsViewable || getstate(wins[i]) == IconicState)
-        manage(wins[i], &wa);
-    }
-    for (i = 0; i < num; i++) { /* now the transients */
-      if (!XGetWindowAttributes(dpy, wins[i], &wa))
-        continue;
-      if (XGetTransientForHint(dpy, wins[i], &d1)
-      && (wa.map_state == IsViewable || getstate(wins[i]) == IconicState))
-        manage(wins[i], &wa);
-    }
+    wa = ecalloc(num + 1, sizeof(XWindowAttributes));
+    kind = ecalloc(num + 1, 1);
+    scanwindows(wins, num, wa, kind);
+    /* 先attach所有窗口，最后只focus一次，布局和_NET_CLIENT_LIST由flushdirty一次完成 */
+    bulk = 1;
+    for (i = 0; i < num; i++)
+      if (kind[i] == 1)
+        manage(wins[i], &wa[i]);
+    for (i = 0; i < num; i++) /* now the transients */
+      if (kind[i] == 2)
+        manage(wins[i], &wa[i]);
+    bulk = 0;
+    focus(NULL);
+    free(kind);
+    free(wa);
     if (wins)
       XFree(wins);
   }
 }
 
+/* 每个窗口只查询一次属性、WM_TRANSIENT_FOR和WM_STATE，kind为0跳过，1直接manage，2为transient */
+void
+scanwindows(Window *wins, unsigned int num, XWindowAttributes *wa, char *kind)
+{
+  unsigned int i;
+#ifdef XCB
+  /* 所有窗口的请求一次发出，再依次取回 */
+  xcb_get_window_attributes_cookie_t *ac = ecalloc(num + 1, sizeof *ac);
+  xcb_get_geometry_cookie_t *gc = ecalloc(num + 1, sizeof *gc);
+  xcb_get_property_cookie_t *tc = ecalloc(num + 1, sizeof *tc);
+  xcb_get_property_cookie_t *sc = ecalloc(num + 1, sizeof *sc);
+  xcb_get_window_attributes_reply_t *a;
+  xcb_get_geometry_reply_t *g;
+  xcb_get_property_reply_t *t, *st;
+  xcb_generic_error_t *e[4];
+  int iconic;
+
+  for (i = 0; i < num; i++) {
+    ac[i] = xcb_get_window_attributes(xcb, wins[i]);
+    gc[i] = xcb_get_geometry(xcb, wins[i]);
+    tc[i] = xcb_get_property(xcb, 0, wins[i], XA_WM_TRANSIENT_FOR, XA_WINDOW, 0, 1);
+    sc[i] = xcb_get_property(xcb, 0, wins[i], wmatom[WMState], wmatom[WMState], 0, 2);
+  }
+  for (i = 0; i < num; i++) {
+    e[0] = e[1] = e[2] = e[3] = NULL;
+    a = xcb_get_window_attributes_reply(xcb, ac[i], &e[0]);
+    g = xcb_get_geometry_reply(xcb, gc[i], &e[1]);
+    t = xcb_get_property_reply(xcb, tc[i], &e[2]);
+    st = xcb_get_property_reply(xcb, sc[i], &e[3]);
+    iconic = st && st->type == wmatom[WMState] && st->format == 32 && st->value_len
+      && *(uint32_t *)xcb_get_property_value(st) == IconicState;
+    if (a && g && !a->override_redirect && (a->map_state == IsViewable || iconic)) {
+      wa[i].x = g->x;
+      wa[i].y = g->y;
+      wa[i].width = g->width;
+      wa[i].height = g->height;
+      wa[i].border_width = g->border_width;
+      wa[i].map_state = a->map_state;
+      kind[i] = t && t->type == XA_WINDOW && t->value_len ? 2 : 1;
+    }
+    free(a);
+    free(g);
+    free(t);
+    free(st);
+    free(e[0]);
+    free(e[1]);
+    free(e[2]);
+    free(e[3]);
+  }
+  free(ac);
+  free(gc);
+  free(tc);
+  free(sc);
+#else
+  Window d1;
+
+  for (i = 0; i < num; i++) {
+    if (!XGetWindowAttributes(dpy, wins[i], &wa[i]) || wa[i].override_redirect
+    || (wa[i].map_state != IsViewable && getstate(wins[i]) != IconicState))
+      continue;
+    kind[i] = XGetTransientForHint(dpy, wins[i], &d1) ? 2 : 1;
+  }
+#endif /* XCB */
+}
+
 void
 sendmon(Client *c, Monitor *m)
 {
@@ -2205,11 +4250,21 @@ sendmon(Client *c, Monitor *m)
   arrange(NULL);
 }
 
+void
+setborderpixel(Client *c, unsigned long pixel)
+{
+  if (c->borderpixel == pixel)
+    return;
+  c->borderpixel = pixel;
+  XSetWindowBorder(dpy, c->win, pixel);
+}
+
 void
 setclientstate(Client *c, long state)
 {
   long data[] = { state, None };
 
+  c->state = state;
   XChangeProperty(dpy, c->win, wmatom[WMState], wmatom[WMState], 32,
     PropModeReplace, (unsigned char *)data, 2);
 }
@@ -2487,138 +4542,563 @@ setlayout(const Arg *arg)
       selmon->pertag->ltidxs[i+1][selmon->sellt] = selmon->lt[selmon->sellt]; 
       selmon->pertag->sellts[i+1] = selmon->sellt;
     }
-  
-  if(selmon->pertag->curtag == 0)
-  {
-    selmon->pertag->ltidxs[0][selmon->sellt] = selmon->lt[selmon->sellt]; 
-    selmon->pertag->sellts[0] = selmon->sellt;
+  
+  if(selmon->pertag->curtag == 0)
+  {
+    selmon->pertag->ltidxs[0][selmon->sellt] = selmon->lt[selmon->sellt]; 
+    selmon->pertag->sellts[0] = selmon->sellt;
+  }
+
+  if (selmon->sel)
+    arrange(selmon);
+  else
+    markdirty(selmon, DirtyBar);
+}
+
+/* arg > 1.0 will set mfact absolutely */
+void
+setmfact(const Arg *arg)
+{
+  float f;
+  unsigned int i;
+
+  if (!arg || !selmon->lt[selmon->sellt]->arrange)
+    return;
+  f = arg->f < 1.0 ? arg->f + selmon->mfact : arg->f - 1.0;
+  if (arg->f == 0.0)
+    f = mfact;
+  if (f < 0.05 || f > 0.95)
+    return;
+  selmon->mfact = f;
+  for(i=0; i<LENGTH(tags); ++i)
+    if(selmon->tagset[selmon->seltags] & 1<<i)
+      selmon->pertag->mfacts[i+1] = f;
+
+  if(selmon->pertag->curtag == 0)
+  {
+    selmon->pertag->mfacts[0] = f;
+  }
+  arrange(selmon);
+}
+
+/* 同一func和arg的定时器只保留一个，重复设置会推迟到期时间 */
+void
+settimer(int ms, void (*func)(void *), void *arg)
+{
+  unsigned int i, slot = LENGTH(timers);
+
+  for (i = 0; i < LENGTH(timers); i++) {
+    if (timers[i].when && timers[i].func == func && timers[i].arg == arg) {
+      slot = i;
+      break;
+    }
+    if (!timers[i].when && slot == LENGTH(timers))
+      slot = i;
+  }
+  if (slot == LENGTH(timers)) {
+    /* 没有空闲槽位时立即执行，保证不会丢失 */
+    func(arg);
+    return;
+  }
+  timers[slot].when = getms() + ms;
+  timers[slot].func = func;
+  timers[slot].arg = arg;
+}
+
+void
+setup(void)
+{
+  int i;
+  XSetWindowAttributes wa;
+  Atom utf8string;
+  struct {
+    Atom *atom;
+    const char *name;
+  } atoms[] = {
+    { &utf8string, "UTF8_STRING" },
+    { &wmatom[WMProtocols], "WM_PROTOCOLS" },
+    { &wmatom[WMDelete], "WM_DELETE_WINDOW" },
+    { &wmatom[WMState], "WM_STATE" },
+    { &wmatom[WMTakeFocus], "WM_TAKE_FOCUS" },
+    { &wmatom[DWMState], "_DWM_STATE" },
+    { &netatom[NetActiveWindow], "_NET_ACTIVE_WINDOW" },
+    { &netatom[NetSupported], "_NET_SUPPORTED" },
+    { &netatom[NetSystemTray], "_NET_SYSTEM_TRAY_S0" },
+    { &netatom[NetSystemTrayOP], "_NET_SYSTEM_TRAY_OPCODE" },
+    { &netatom[NetSystemTrayOrientation], "_NET_SYSTEM_TRAY_ORIENTATION" },
+    { &netatom[NetSystemTrayOrientationHorz], "_NET_SYSTEM_TRAY_ORIENTATION_HORZ" },
+    { &netatom[NetWMName], "_NET_WM_NAME" },
+    { &netatom[NetWMState], "_NET_WM_STATE" },
+    { &netatom[NetWMCheck], "_NET_SUPPORTING_WM_CHECK" },
+    { &netatom[NetWMFullscreen], "_NET_WM_STATE_FULLSCREEN" },
+    { &netatom[NetWMWindowType], "_NET_WM_WINDOW_TYPE" },
+    { &netatom[NetWMWindowTypeDialog], "_NET_WM_WINDOW_TYPE_DIALOG" },
+    { &netatom[NetClientList], "_NET_CLIENT_LIST" },
+    { &netatom[NetWMSyncRequest], "_NET_WM_SYNC_REQUEST" },
+    { &netatom[NetWMSyncRequestCounter], "_NET_WM_SYNC_REQUEST_COUNTER" },
+    { &xatom[Manager], "MANAGER" },
+    { &xatom[Xembed], "_XEMBED" },
+    { &xatom[XembedInfo], "_XEMBED_INFO" },
+  };
+  char *atomnames[LENGTH(atoms)];
+  Atom atomvals[LENGTH(atoms)];
+
+  /* clean up any zombies immediately */
+  sigchld(0);
+
+  /* init screen */
+  screen = DefaultScreen(dpy);
+  sw = DisplayWidth(dpy, screen);
+  sh = DisplayHeight(dpy, screen);
+  root = RootWindow(dpy, screen);
+#ifdef XCB
+  xcb = XGetXCBConnection(dpy);
+#endif
+  xinitvisual();
+  drw = drw_create(dpy, screen, root, sw, sh, visual, depth, cmap);
+#ifdef XSYNC
+  {
+    int err, major, minor;
+
+    if (!XSyncQueryExtension(dpy, &syncevbase, &err) || !XSyncInitialize(dpy, &major, &minor))
+      syncevbase = -1;
+  }
+#endif /* XSYNC */
+  startphase("screen");
+  if (!drw_fontset_create(drw, fonts, LENGTH(fonts)))
+    die("no fonts could be loaded.");
+  lrpad = drw->fonts->h;
+  bh = drw->fonts->h + 2;
+  startphase("fonts");
+  updategeom();
+  startphase("geom");
+  /* init atoms，一次请求intern所有atom */
+  for (i = 0; i < LENGTH(atoms); i++)
+    atomnames[i] = (char *)atoms[i].name;
+  XInternAtoms(dpy, atomnames, LENGTH(atoms), False, atomvals);
+  for (i = 0; i < LENGTH(atoms); i++)
+    *atoms[i].atom = atomvals[i];
+  startphase("atoms");
+  /* init cursors */
+  // https://tronche.com/gui/x/xlib/appendix/b/
+  cursor[CurNormal] = drw_cur_create(drw, XC_left_ptr);
+  // cursor[CurResize] = drw_cur_create(drw, XC_sizing);
+  cursor[CurResize] = drw_cur_create(drw, XC_bottom_right_corner);
+  cursor[CurMove] = drw_cur_create(drw, XC_fleur);
+  /* init appearance */
+  setupconfig();
+  scheme = ecalloc(LENGTH(colors), sizeof(Clr *));
+  for (i = 0; i < LENGTH(colors); i++)
+    scheme[i] = drw_scm_create(drw, ccolors[i], alphas[i], 3);
+  startphase("appearance");
+  /* init system tray */
+  updatesystray();
+  /* init bars */
+  updatebars();
+  updatestatus();
+  startphase("bars");
+  /* supporting window for NetWMCheck */
+  wmcheckwin = XCreateSimpleWindow(dpy, root, 0, 0, 1, 1, 0, 0, 0);
+  XChangeProperty(dpy, wmcheckwin, netatom[NetWMCheck], XA_WINDOW, 32,
+    PropModeReplace, (unsigned char *) &wmcheckwin, 1);
+  XChangeProperty(dpy, wmcheckwin, netatom[NetWMName], utf8string, 8,
+    PropModeReplace, (unsigned char *) "dwm", 3);
+  XChangeProperty(dpy, root, netatom[NetWMCheck], XA_WINDOW, 32,
+    PropModeReplace, (unsigned char *) &wmcheckwin, 1);
+  /* EWMH support per view */
+  XChangeProperty(dpy, root, netatom[NetSupported], XA_ATOM, 32,
+    PropModeReplace, (unsigned char *) netatom, NetLast);
+  XDeleteProperty(dpy, root, netatom[NetClientList]);
+  /* select events */
+  wa.cursor = cursor[CurNormal]->cursor;
+  wa.event_mask = SubstructureRedirectMask|SubstructureNotifyMask
+    |ButtonPressMask|PointerMotionMask|EnterWindowMask
+    |LeaveWindowMask|StructureNotifyMask|PropertyChangeMask;
+  XChangeWindowAttributes(dpy, root, CWEventMask|CWCursor, &wa);
+  XSelectInput(dpy, root, wa.event_mask);
+  /* 自动重复只产生连续的KeyPress，不再夹杂KeyRelease，便于合并和判断按键松开 */
+  XkbSetDetectableAutoRepeat(dpy, True, NULL);
+#ifdef XTEST
+  {
+    int evbase, errbase, major, minor;
+
+    xtest = XTestQueryExtension(dpy, &evbase, &errbase, &major, &minor);
+  }
+#endif /* XTEST */
+  grabkeys();
+  startphase("root");
+  setupstatusdir();
+  setupsession();
+  watchfd(ConnectionNumber(dpy), POLLIN, NULL);
+  setupipc();
+  setupstatusfifo();
+  setupstatusmodules();
+  focus(NULL);
+  startphase("ipc");
+}
+
+void
+setstatus(const char *text)
+{
+  if (!strcmp(text, exttext))
+    return;
+  strncpy(exttext, text, sizeof exttext - 1);
+  composestatus();
+}
+
+/* path上有进程在监听时返回1，重启时旧进程已经关闭并删除了socket */
+int
+sockinuse(const char *path)
+{
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  int fd, r;
+
+  if ((fd = socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0)) < 0)
+    return 0;
+  strncpy(addr.sun_path, path, sizeof addr.sun_path - 1);
+  r = connect(fd, (struct sockaddr *)&addr, sizeof addr) == 0 || errno == EAGAIN;
+  close(fd);
+  return r;
+}
+
+/* path是已经有读者的fifo时返回1：没有读者时非阻塞的只写open会以ENXIO失败 */
+int
+fifoinuse(const char *path)
+{
+  struct stat st;
+  int fd;
+
+  if (stat(path, &st) < 0 || !S_ISFIFO(st.st_mode)
+  || (fd = open(path, O_WRONLY|O_NONBLOCK|O_CLOEXEC)) < 0)
+    return 0;
+  close(fd);
+  return 1;
+}
+
+/* 控制socket，默认为$XDG_RUNTIME_DIR/dwm-$DISPLAY.sock，路径通过DWM_SOCKET传给子进程 */
+void
+setupipc(void)
+{
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  const char *dir, *display;
+  unsigned int i;
+  char *p;
+
+  for (i = 0; i < LENGTH(ipcconns); i++)
+    ipcconns[i].fd = -1;
+  /* DWM_SOCKET会被子进程继承，嵌套运行的dwm（如Xephyr中）不能抢走还有人监听的socket */
+  if ((p = getenv("DWM_SOCKET")) && *p && !sockinuse(p))
+    snprintf(ipcpath, sizeof ipcpath, "%s", p);
+  else {
+    if (!(dir = getenv("XDG_RUNTIME_DIR")) || !*dir)
+      dir = "/tmp";
+    if (!(display = getenv("DISPLAY")))
+      display = "";
+    snprintf(ipcpath, sizeof ipcpath, "%s/dwm-%s.sock", dir, display);
+    for (p = ipcpath + strlen(dir) + 1; *p; p++)
+      if (*p == '/')
+        *p = '_';
+  }
+  if (sockinuse(ipcpath)) {
+    fprintf(stderr, "dwm: ipc socket '%s' is in use by another process\n", ipcpath);
+    return;
+  }
+  strncpy(addr.sun_path, ipcpath, sizeof addr.sun_path - 1);
+  if ((ipcfd = socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0)) < 0) {
+    fprintf(stderr, "dwm: ipc socket: %s\n", strerror(errno));
+    return;
+  }
+  unlink(ipcpath);
+  if (bind(ipcfd, (struct sockaddr *)&addr, sizeof addr) < 0
+  || listen(ipcfd, 8) < 0 || watchfd(ipcfd, POLLIN, ipcaccept) < 0) {
+    fprintf(stderr, "dwm: ipc socket '%s': %s\n", ipcpath, strerror(errno));
+    close(ipcfd);
+    ipcfd = -1;
+    return;
+  }
+  setenv("DWM_SOCKET", ipcpath, 1);
+}
+
+/* 状态栏FIFO，默认为$XDG_RUNTIME_DIR/dwm-status-$DISPLAY，路径通过DWM_STATUS_FIFO传给子进程
+ * 以O_RDWR打开，写入端全部关闭时不会一直触发POLLHUP */
+void
+setupstatusfifo(void)
+{
+  const char *dir, *display;
+  struct stat st;
+  char *p;
+
+  /* 和DWM_SOCKET一样，继承来的fifo已有读者时说明属于另一个dwm */
+  if ((p = getenv("DWM_STATUS_FIFO")) && *p && !fifoinuse(p))
+    snprintf(statuspath, sizeof statuspath, "%s", p);
+  else {
+    if (!(dir = getenv("XDG_RUNTIME_DIR")) || !*dir)
+      dir = "/tmp";
+    if (!(display = getenv("DISPLAY")))
+      display = "";
+    snprintf(statuspath, sizeof statuspath, "%s/dwm-status-%s", dir, display);
+    for (p = statuspath + strlen(dir) + 1; *p; p++)
+      if (*p == '/')
+        *p = '_';
+  }
+  if (fifoinuse(statuspath)) {
+    fprintf(stderr, "dwm: status fifo '%s' is in use by another process\n", statuspath);
+    return;
+  }
+  if (mkfifo(statuspath, 0600) < 0 && errno != EEXIST) {
+    fprintf(stderr, "dwm: status fifo '%s': %s\n", statuspath, strerror(errno));
+    return;
+  }
+  if (stat(statuspath, &st) < 0 || !S_ISFIFO(st.st_mode)) {
+    fprintf(stderr, "dwm: status fifo '%s' is not a fifo\n", statuspath);
+    return;
+  }
+  if ((statusfd = open(statuspath, O_RDWR|O_NONBLOCK|O_CLOEXEC)) < 0
+  || watchfd(statusfd, POLLIN, statusread) < 0) {
+    fprintf(stderr, "dwm: status fifo '%s': %s\n", statuspath, strerror(errno));
+    if (statusfd >= 0)
+      close(statusfd);
+    statusfd = -1;
+    return;
+  }
+  setenv("DWM_STATUS_FIFO", statuspath, 1);
+}
+
+void
+setupstatusmodules(void)
+{
+  unsigned int i;
+
+  for (i = 0; i < LENGTH(statusstates); i++)
+    statusstates[i].fd[0] = statusstates[i].fd[1] = -1;
+  if (!LENGTH(statusmodules))
+    return;
+  if ((statustimerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC)) < 0
+  || watchfd(statustimerfd, POLLIN, statustimer) < 0) {
+    fprintf(stderr, "dwm: status timer: %s\n", strerror(errno));
+    if (statustimerfd >= 0)
+      close(statustimerfd);
+    statustimerfd = -1;
+    return;
+  }
+  statustimer(statustimerfd, POLLIN);
+}
+
+// 创建~/.cache/dwm/status，失败时不发布状态
+void
+setupstatusdir(void)
+{
+  const char *home;
+  const char *sub[] = { "/.cache", "/.cache/dwm", "/.cache/dwm/status" };
+  unsigned int i;
+
+  statusdir[0] = '\0';
+  if (!(home = getenv("HOME")))
+    return;
+  for (i = 0; i < LENGTH(sub); i++) {
+    snprintf(statusdir, sizeof statusdir, "%s%s", home, sub[i]);
+    if (mkdir(statusdir, 0755) < 0 && errno != EEXIST) {
+      fprintf(stderr, "dwm: cannot create '%s': %s\n", statusdir, strerror(errno));
+      statusdir[0] = '\0';
+      return;
+    }
+  }
+}
+
+/* mmap会话快照，有效时恢复各monitor的pertag，无效或版本不同时重新开始 */
+void
+setupsession(void)
+{
+  char path[512], *p;
+  const char *home, *display;
+  Session *ss, *slots;
+  Monitor *m;
+  Pertag *pt;
+  unsigned int t;
+  int fd, i;
+
+  if (!(home = getenv("HOME")))
+    return;
+  /* 按display区分，嵌套运行的dwm不会覆盖外层的快照 */
+  if (!(display = getenv("DISPLAY")))
+    display = "";
+  snprintf(path, sizeof path, "%s/.cache/dwm/session-%s", home, display);
+  for (p = path + strlen(home) + strlen("/.cache/dwm/"); *p; p++)
+    if (*p == '/')
+      *p = '_';
+  if ((fd = open(path, O_RDWR|O_CREAT|O_CLOEXEC, 0644)) < 0)
+    return;
+  if (ftruncate(fd, 2 * sizeof(Session)) < 0
+  || (slots = mmap(NULL, 2 * sizeof(Session), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+    close(fd);
+    return;
+  }
+  close(fd);
+  sessionslots = slots;
+  session = ss = &sessionbuf;
+  /* 取两个槽位中有效且较新的一个 */
+  for (i = 0, t = 2; i < 2; i++)
+    if (slots[i].magic == 0x53574d44 && slots[i].version == 1 && slots[i].ntags == LENGTH(tags)
+    && slots[i].checksum == sessionsum(&slots[i]) && (t == 2 || slots[i].stamp > slots[t].stamp))
+      t = i;
+  if (t == 2) {
+    memset(ss, 0, sizeof(Session));
+    ss->magic = 0x53574d44; /* "DMWS" */
+    ss->version = 1;
+    ss->ntags = LENGTH(tags);
+    return;
+  }
+  memcpy(ss, &slots[t], sizeof(Session));
+  for (m = mons; m; m = m->next) {
+    if (m->num >= LENGTH(ss->mons) || !ss->mons[m->num].valid)
+      continue;
+    pt = m->pertag;
+    i = m->num;
+    pt->curtag = ss->mons[i].curtag % (LENGTH(tags) + 1);
+    pt->prevtag = ss->mons[i].prevtag % (LENGTH(tags) + 1);
+    for (t = 0; t <= LENGTH(tags); t++) {
+      pt->nmasters[t] = ss->mons[i].nmasters[t];
+      pt->mfacts[t] = ss->mons[i].mfacts[t];
+      pt->sellts[t] = ss->mons[i].sellts[t] & 1;
+      pt->ltidxs[t][0] = &layouts[(unsigned int)ss->mons[i].ltidxs[t][0] % LENGTH(layouts)];
+      pt->ltidxs[t][1] = &layouts[(unsigned int)ss->mons[i].ltidxs[t][1] % LENGTH(layouts)];
+      pt->showbars[t] = ss->mons[i].showbars[t];
+    }
+    /* 恢复到保存时所在的tag */
+    if (pt->curtag) {
+      m->tagset[m->seltags] = 1 << (pt->curtag - 1);
+    }
+    applypertag(m);
   }
+}
 
-  if (selmon->sel)
-    arrange(selmon);
-  else
-    drawbar(selmon);
+/* FNV-1a */
+unsigned int
+sessionsum(const Session *ss)
+{
+  const unsigned char *p = (const unsigned char *)&ss->checksum + sizeof ss->checksum;
+  const unsigned char *end = (const unsigned char *)(ss + 1);
+  unsigned int h = 2166136261u;
+
+  for (; p < end; p++)
+    h = (h ^ *p) * 16777619u;
+  return h;
 }
 
-/* arg > 1.0 will set mfact absolutely */
+/* 状态变化后调用，最多每sessiondelay ms保存一次 */
 void
-setmfact(const Arg *arg)
+marksession(void)
 {
-  float f;
-  unsigned int i;
-
-  if (!arg || !selmon->lt[selmon->sellt]->arrange)
-    return;
-  f = arg->f < 1.0 ? arg->f + selmon->mfact : arg->f - 1.0;
-  if (arg->f == 0.0)
-    f = mfact;
-  if (f < 0.05 || f > 0.95)
+  if (!session || sessionpending)
     return;
-  selmon->mfact = f;
-  for(i=0; i<LENGTH(tags); ++i)
-    if(selmon->tagset[selmon->seltags] & 1<<i)
-      selmon->pertag->mfacts[i+1] = f;
+  sessionpending = 1;
+  settimer(sessiondelay, savesession, NULL);
+}
 
-  if(selmon->pertag->curtag == 0)
-  {
-    selmon->pertag->mfacts[0] = f;
+/* 把pertag和浮动窗口的几何写入快照，msync异步写回磁盘 */
+void
+savesession(void *arg)
+{
+  Session *ss = session;
+  Monitor *m;
+  Client *c;
+  unsigned int i, t, old;
+  int n;
+
+  sessionpending = 0;
+  ss->stamp++;
+  for (m = mons; m; m = m->next) {
+    if ((n = m->num) >= LENGTH(ss->mons))
+      continue;
+    ss->mons[n].valid = 1;
+    ss->mons[n].curtag = m->pertag->curtag;
+    ss->mons[n].prevtag = m->pertag->prevtag;
+    for (t = 0; t <= LENGTH(tags); t++) {
+      ss->mons[n].nmasters[t] = m->pertag->nmasters[t];
+      ss->mons[n].mfacts[t] = m->pertag->mfacts[t];
+      ss->mons[n].sellts[t] = m->pertag->sellts[t];
+      ss->mons[n].ltidxs[t][0] = m->pertag->ltidxs[t][0] - layouts;
+      ss->mons[n].ltidxs[t][1] = m->pertag->ltidxs[t][1] - layouts;
+      ss->mons[n].showbars[t] = m->pertag->showbars[t];
+    }
+    for (c = m->clients; c; c = c->next) {
+      if (!c->isfloating || c->isfullscreen || !ISVISIBLE(c) || !strcmp(c->class, broken))
+        continue;
+      /* 同一class的记录，没有时替换最久未更新的 */
+      for (i = 0, old = 0; i < LENGTH(ss->places); i++) {
+        if (!strcmp(ss->places[i].class, c->class))
+          break;
+        if (ss->places[i].stamp < ss->places[old].stamp)
+          old = i;
+      }
+      if (i == LENGTH(ss->places)) {
+        i = old;
+        snprintf(ss->places[i].class, sizeof ss->places[i].class, "%s", c->class);
+      }
+      ss->places[i].stamp = ss->stamp;
+      ss->places[i].x = c->x;
+      ss->places[i].y = c->y;
+      ss->places[i].w = c->w;
+      ss->places[i].h = c->h;
+    }
   }
-  arrange(selmon);
+  ss->checksum = sessionsum(ss);
+  /* stamp每次加1，两个槽位轮流写入，另一个保存着上一次完整的快照 */
+  memcpy(&sessionslots[ss->stamp & 1], ss, sizeof(Session));
+  msync(&sessionslots[ss->stamp & 1], sizeof(Session), MS_ASYNC);
 }
 
+/* publishstatus的定时器到期后调用，只写有变化的文件 */
 void
-setup(void)
+savestatus(void *arg)
 {
-  int i;
-  XSetWindowAttributes wa;
-  Atom utf8string;
+  Window selwin;
+  unsigned int seltags;
 
-  /* clean up any zombies immediately */
-  sigchld(0);
+  if (!statusdir[0] || !selmon)
+    return;
+  if (selmon->num != published.selmon) {
+    published.selmon = selmon->num;
+    writestatus("selmon", "%d\n", selmon->num);
+  }
+  selwin = selmon->sel ? selmon->sel->win : None;
+  if (selwin != published.selwin) {
+    published.selwin = selwin;
+    writestatus("selwin", "%lu\n", selwin);
+  }
+  seltags = selmon->tagset[selmon->seltags];
+  if (seltags != published.seltags) {
+    published.seltags = seltags;
+    writestatus("seltags", "%u\n", seltags);
+  }
+}
 
-  /* init screen */
-  screen = DefaultScreen(dpy);
-  sw = DisplayWidth(dpy, screen);
-  sh = DisplayHeight(dpy, screen);
-  root = RootWindow(dpy, screen);
-  xinitvisual();
-  drw = drw_create(dpy, screen, root, sw, sh, visual, depth, cmap);
-  if (!drw_fontset_create(drw, fonts, LENGTH(fonts)))
-    die("no fonts could be loaded.");
-  lrpad = drw->fonts->h;
-  bh = drw->fonts->h + 2;
-  updategeom();
-  /* init atoms */
-  utf8string = XInternAtom(dpy, "UTF8_STRING", False);
-  wmatom[WMProtocols] = XInternAtom(dpy, "WM_PROTOCOLS", False);
-  wmatom[WMDelete] = XInternAtom(dpy, "WM_DELETE_WINDOW", False);
-  wmatom[WMState] = XInternAtom(dpy, "WM_STATE", False);
-  wmatom[WMTakeFocus] = XInternAtom(dpy, "WM_TAKE_FOCUS", False);
-  netatom[NetActiveWindow] = XInternAtom(dpy, "_NET_ACTIVE_WINDOW", False);
-  netatom[NetSupported] = XInternAtom(dpy, "_NET_SUPPORTED", False);
-  netatom[NetSystemTray] = XInternAtom(dpy, "_NET_SYSTEM_TRAY_S0", False);
-  netatom[NetSystemTrayOP] = XInternAtom(dpy, "_NET_SYSTEM_TRAY_OPCODE", False);
-  netatom[NetSystemTrayOrientation] = XInternAtom(dpy, "_NET_SYSTEM_TRAY_ORIENTATION", False);
-  netatom[NetSystemTrayOrientationHorz] = XInternAtom(dpy, "_NET_SYSTEM_TRAY_ORIENTATION_HORZ", False);
-  netatom[NetWMName] = XInternAtom(dpy, "_NET_WM_NAME", False);
-  netatom[NetWMState] = XInternAtom(dpy, "_NET_WM_STATE", False);
-  netatom[NetWMCheck] = XInternAtom(dpy, "_NET_SUPPORTING_WM_CHECK", False);
-  netatom[NetWMFullscreen] = XInternAtom(dpy, "_NET_WM_STATE_FULLSCREEN", False);
-  netatom[NetWMWindowType] = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE", False);
-  netatom[NetWMWindowTypeDialog] = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE_DIALOG", False);
-  netatom[NetClientList] = XInternAtom(dpy, "_NET_CLIENT_LIST", False);
-  xatom[Manager] = XInternAtom(dpy, "MANAGER", False);
-  xatom[Xembed] = XInternAtom(dpy, "_XEMBED", False);
-  xatom[XembedInfo] = XInternAtom(dpy, "_XEMBED_INFO", False);
-  /* init cursors */
-  // https://tronche.com/gui/x/xlib/appendix/b/
-  cursor[CurNormal] = drw_cur_create(drw, XC_left_ptr);
-  // cursor[CurResize] = drw_cur_create(drw, XC_sizing);
-  cursor[CurResize] = drw_cur_create(drw, XC_bottom_right_corner);
-  cursor[CurMove] = drw_cur_create(drw, XC_fleur);
-  /* init appearance */
-  scheme = ecalloc(LENGTH(colors), sizeof(Clr *));
-  for (i = 0; i < LENGTH(colors); i++)
-    scheme[i] = drw_scm_create(drw, colors[i], alphas[i], 3);
-  /* init system tray */
-  updatesystray();
-  /* init bars */
-  updatebars();
-  updatestatus();
-  /* supporting window for NetWMCheck */
-  wmcheckwin = XCreateSimpleWindow(dpy, root, 0, 0, 1, 1, 0, 0, 0);
-  XChangeProperty(dpy, wmcheckwin, netatom[NetWMCheck], XA_WINDOW, 32,
-    PropModeReplace, (unsigned char *) &wmcheckwin, 1);
-  XChangeProperty(dpy, wmcheckwin, netatom[NetWMName], utf8string, 8,
-    PropModeReplace, (unsigned char *) "dwm", 3);
-  XChangeProperty(dpy, root, netatom[NetWMCheck], XA_WINDOW, 32,
-    PropModeReplace, (unsigned char *) &wmcheckwin, 1);
-  /* EWMH support per view */
-  XChangeProperty(dpy, root, netatom[NetSupported], XA_ATOM, 32,
-    PropModeReplace, (unsigned char *) netatom, NetLast);
-  XDeleteProperty(dpy, root, netatom[NetClientList]);
-  /* select events */
-  wa.cursor = cursor[CurNormal]->cursor;
-  wa.event_mask = SubstructureRedirectMask|SubstructureNotifyMask
-    |ButtonPressMask|PointerMotionMask|EnterWindowMask
-    |LeaveWindowMask|StructureNotifyMask|PropertyChangeMask;
-  XChangeWindowAttributes(dpy, root, CWEventMask|CWCursor, &wa);
-  XSelectInput(dpy, root, wa.event_mask);
-  grabkeys();
-  focus(NULL);
+/* 新的浮动窗口使用同一class上次的几何，在第一次map之前设置 */
+void
+placeclient(Client *c)
+{
+  unsigned int i;
+
+  if (!session || !c->isfloating || !strcmp(c->class, broken))
+    return;
+  for (i = 0; i < LENGTH(session->places); i++)
+    if (!strcmp(session->places[i].class, c->class)) {
+      c->x = session->places[i].x;
+      c->y = session->places[i].y;
+      c->w = session->places[i].w;
+      c->h = session->places[i].h;
+      return;
+    }
 }
 
 void
 seturgent(Client *c, int urg)
 {
-  XWMHints *wmh;
-
   c->isurgent = urg;
-  if (!(wmh = XGetWMHints(dpy, c->win)))
+  if (!c->haswmh)
     return;
-  wmh->flags = urg ? (wmh->flags | XUrgencyHint) : (wmh->flags & ~XUrgencyHint);
-  XSetWMHints(dpy, c->win, wmh);
-  XFree(wmh);
+  c->wmh.flags = urg ? (c->wmh.flags | XUrgencyHint) : (c->wmh.flags & ~XUrgencyHint);
+  XSetWMHints(dpy, c->win, &c->wmh);
 }
 
 void
@@ -2666,17 +5146,21 @@ showhide(Client *c)
 {
   if (!c)
     return;
+  /* 只修改want，随后的arrange可能再次修改，最终由commitgeoms统一提交 */
   if (ISVISIBLE(c)) {
     /* show clients top down */
-    XMoveWindow(dpy, c->win, c->x, c->y);
+    c->want.x = c->x;
+    c->want.y = c->y;
     if ((!c->mon->lt[c->mon->sellt]->arrange || c->isfloating) && !c->isfullscreen)
       resize(c, c->x, c->y, c->w, c->h, 0);
     showhide(c->snext);
   } else {
     /* hide clients bottom up */
     showhide(c->snext);
-    XMoveWindow(dpy, c->win, WIDTH(c) * -2, c->y);
+    c->want.x = WIDTH(c) * -2;
+    c->want.y = c->y;
   }
+  geomdirty = 1;
 }
 
 void
@@ -2715,6 +5199,7 @@ tag(const Arg *arg)
 {
   if (selmon->sel && arg->ui & TAGMASK) {
     selmon->sel->tags = arg->ui & TAGMASK;
+    updatetaglabels(selmon);
     // 跳到新的tag
     view(arg);
     // 聚焦到客户端
@@ -2942,6 +5427,7 @@ toggletag(const Arg *arg)
   newtags = selmon->sel->tags ^ (arg->ui & TAGMASK);
   if (newtags) {
     selmon->sel->tags = newtags;
+    updatetaglabels(selmon);
     focus(NULL);
     arrange(selmon);
   }
@@ -3027,7 +5513,7 @@ unfocus(Client *c, int setfocus)
   }
 
   grabbuttons(c, 0);
-  XSetWindowBorder(dpy, c->win, scheme[SchemeNorm][ColBorder].pixel);
+  setborderpixel(c, scheme[SchemeNorm][ColBorder].pixel);
   if (setfocus) {
     XSetInputFocus(dpy, root, RevertToPointerRoot, CurrentTime);
     XDeleteProperty(dpy, root, netatom[NetActiveWindow]);
@@ -3035,93 +5521,386 @@ unfocus(Client *c, int setfocus)
 }
 
 void
-togglewin(const Arg *arg)
+togglewin(const Arg *arg)
+{
+	Client *c = (Client*)arg->v;
+  if (!c) {
+    c = selmon->sel;
+  }
+  if (!c) {
+    return;
+  }
+	if (c == selmon->sel) { // 当前窗口就是选中窗口
+    if (c->hid) {
+			showwin(c, 1);
+    } else {
+      // 尝试找当前可见的不隐藏fc
+      Client *fc;
+      for (fc = selmon->clients; fc && (!ISVISIBLE(fc) || HIDDEN(fc) || fc == c); fc = fc->snext);
+      if (fc) {
+        // fc存在则隐藏当前窗口然后切到fc
+        hidewin(c);
+        focus(fc);
+      } else {
+        // fc不存在，说明找不到一个合适的窗口，那么还是显示当前窗口，仅设置hid标识
+        c->hid = 1;
+      }
+    }
+	} else { // 当前窗口不是选中窗口
+		if (c->hid) {
+			showwin(c, 1);
+      focus(c);
+    } else {
+      hidewin(c);
+    }
+	}
+  arrange(c->mon);
+}
+
+void
+unmanage(Client *c, int destroyed)
+{
+  Monitor *m = c->mon;
+  XWindowChanges wc;
+
+  Client *sc;
+  if (findscratch(&sc) && sc == c) {
+    // 去除scratchtag标志位
+    selmon->tagset[selmon->seltags] &= ~scratchtag;
+    selmon->tagset[selmon->seltags ^ 1] &= ~scratchtag;
+  }
+
+  wintabdel(c->win);
+  outlineend(c);
+  deltimers(c);
+  if (c == dragclient)
+    dragclient = NULL;
+#ifdef XSYNC
+  if (c == syncclient)
+    syncclient = NULL;
+#endif
+  ipcevent("unmanage %d 0x%lx", m->num, c->win);
+  detach(c);
+  detachstack(c);
+  if (!destroyed) {
+    wc.border_width = c->oldbw;
+    /* 批量模式下由调用者统一grab server和同步 */
+    if (!bulk) {
+      XGrabServer(dpy); /* avoid race conditions */
+      XSetErrorHandler(xerrordummy);
+    }
+    XSelectInput(dpy, c->win, NoEventMask);
+    XConfigureWindow(dpy, c->win, CWBorderWidth, &wc); /* restore border */
+    XUngrabButton(dpy, AnyButton, AnyModifier, c->win);
+    setclientstate(c, WithdrawnState);
+    if (!bulk) {
+      XSync(dpy, False); /* 同步点：窗口可能已经销毁，错误要在xerrordummy生效期间收到 */
+      XSetErrorHandler(xerror);
+      XUngrabServer(dpy);
+    }
+  }
+  free(c);
+  if (!bulk)
+    focus(NULL);
+  clientlistdirty = 1;
+  arrange(m);
+}
+
+void
+unmapnotify(XEvent *e)
+{
+  Client *c;
+  XUnmapEvent *ev = &e->xunmap;
+
+  if ((c = wintoclient(ev->window))) {
+    if (ev->send_event)
+      setclientstate(c, WithdrawnState);
+    else
+      unmanage(c, 0);
+  }
+  else if ((c = wintosystrayicon(ev->window))) {
+    /* KLUDGE! sometimes icons occasionally unmap their windows, but do
+     * _not_ destroy them. We map those windows back */
+    XMapRaised(dpy, c->win);
+    updatesystray();
+  }
+}
+
+#ifdef STATS
+void
+reqbegin(ReqMark *mark)
+{
+  mark->request = XNextRequest(dpy);
+  mark->roundtrips = xroundtrips;
+  mark->flushes = xflushes;
+}
+
+/* 嵌套的操作（如manage中的focus）各自计入自己的统计 */
+void
+reqend(int op, ReqMark *mark)
+{
+  ReqStat *st = &reqstats[op];
+  unsigned long requests = XNextRequest(dpy) - mark->request;
+  unsigned long roundtrips = xroundtrips - mark->roundtrips;
+
+  st->count++;
+  st->requests += requests;
+  st->roundtrips += roundtrips;
+  st->flushes += xflushes - mark->flushes + roundtrips;
+  st->maxrequests = MAX(st->maxrequests, requests);
+  st->maxroundtrips = MAX(st->maxroundtrips, roundtrips);
+}
+
+void
+statrecord(Stat *st, long long start, Window w)
+{
+  unsigned long us = getus() - start;
+  unsigned int i;
+
+  for (i = 0; i < LENGTH(st->hist) - 1 && us >> (i + 1); i++);
+  st->hist[i]++;
+  st->count++;
+  st->total += us;
+  if (us >= st->max) {
+    st->max = us;
+    st->maxwin = w;
+  }
+}
+#endif
+
+/* 把上一次标记到现在的耗时记为name阶段，name为NULL时只设置起点 */
+void
+startphase(const char *name)
+{
+  long long now = getus();
+
+  if (name && nstartphases < LENGTH(startphases)) {
+    startphases[nstartphases].name = name;
+    startphases[nstartphases++].us = now - startmark;
+  }
+  startmark = now;
+}
+
+/* 启动耗时输出到stderr，同时写入statusdir/startup */
+void
+startreport(void)
+{
+  char buf[512];
+  size_t len = 0;
+  long long total = 0;
+  unsigned int i;
+
+  buf[0] = '\0';
+  for (i = 0; i < nstartphases && len < sizeof buf; i++) {
+    total += startphases[i].us;
+    len += snprintf(buf + len, sizeof buf - len, " %s %.1fms",
+      startphases[i].name, startphases[i].us / 1000.0);
+  }
+  fprintf(stderr, "dwm: startup %.1fms:%s\n", total / 1000.0, buf);
+  if (statusdir[0])
+    writestatus("startup", "%.1fms:%s\n", total / 1000.0, buf);
+}
+
+/* 一次读到多行时只取最后一个完整的行 */
+void
+statusread(int fd, short revents)
+{
+  static char buf[sizeof stext];
+  static size_t len;
+  char *line, *nl, *last = NULL;
+  ssize_t n;
+
+  while ((n = read(fd, buf + len, sizeof buf - len - 1)) > 0) {
+    len += n;
+    buf[len] = '\0';
+    for (line = buf; (nl = strchr(line, '\n')); line = nl + 1) {
+      *nl = '\0';
+      last = line;
+    }
+    if (last) {
+      setstatus(last);
+      last = NULL;
+    }
+    len -= line - buf;
+    memmove(buf, line, len);
+    /* 超长的行直接丢弃 */
+    if (len == sizeof buf - 1)
+      len = 0;
+  }
+}
+
+/* 更新到期的模块，再把timerfd设到最近的下一次更新 */
+void
+statustimer(int fd, short revents)
+{
+  struct itimerspec its = {0};
+  uint64_t expirations;
+  long long now, next = -1;
+  char text[sizeof statusstates[0].text];
+  unsigned int i;
+  int changed = 0;
+
+  if (read(fd, &expirations, sizeof expirations) < 0 && errno != EAGAIN)
+    return;
+  now = getms();
+  for (i = 0; i < LENGTH(statusmodules); i++) {
+    StatusState *st = &statusstates[i];
+    if (st->next <= now) {
+      text[0] = '\0';
+      statusmodules[i].func(st, statusmodules[i].arg, text, sizeof text);
+      st->last = now;
+      st->next = now + MAX(statusmodules[i].interval, 100);
+      if (strcmp(text, st->text)) {
+        strcpy(st->text, text);
+        changed = 1;
+      }
+    }
+    if (next < 0 || st->next < next)
+      next = st->next;
+  }
+  if (changed)
+    composestatus();
+  if (next >= 0) {
+    its.it_value.tv_sec = next / 1000;
+    its.it_value.tv_nsec = next % 1000 * 1000000;
+    timerfd_settime(fd, TFD_TIMER_ABSTIME, &its, NULL);
+  }
+}
+
+/* /sys/class/power_supply/arg的电量，没有电池时输出为空 */
+void
+stbattery(StatusState *st, const char *arg, char *buf, size_t size)
+{
+  char path[128], cap[16], status[32];
+
+  snprintf(path, sizeof path, "/sys/class/power_supply/%s/capacity", arg);
+  if (stread(st, 0, path, cap, sizeof cap) <= 0)
+    return;
+  snprintf(path, sizeof path, "/sys/class/power_supply/%s/status", arg);
+  if (stread(st, 1, path, status, sizeof status) <= 0)
+    status[0] = '\0';
+  snprintf(buf, size, "%s%d%%", !strncmp(status, "Charging", 8) ? "+" : "", atoi(cap));
+}
+
+void
+stclock(StatusState *st, const char *arg, char *buf, size_t size)
+{
+  time_t t = time(NULL);
+  struct tm tm;
+
+  if (localtime_r(&t, &tm))
+    strftime(buf, size, arg, &tm);
+}
+
+/* /proc/stat第一行，两次采样之间非空闲时间的比例 */
+void
+stcpu(StatusState *st, const char *arg, char *buf, size_t size)
 {
-	Client *c = (Client*)arg->v;
-  if (!c) {
-    c = selmon->sel;
-  }
-  if (!c) {
+  char data[256];
+  unsigned long long v[8] = {0}, total = 0, idle;
+  unsigned int i;
+
+  if (stread(st, 0, "/proc/stat", data, sizeof data) <= 0)
     return;
-  }
-	if (c == selmon->sel) { // 当前窗口就是选中窗口
-    if (c->hid) {
-			showwin(c, 1);
-    } else {
-      // 尝试找当前可见的不隐藏fc
-      Client *fc;
-      for (fc = selmon->clients; fc && (!ISVISIBLE(fc) || HIDDEN(fc) || fc == c); fc = fc->snext);
-      if (fc) {
-        // fc存在则隐藏当前窗口然后切到fc
-        hidewin(c);
-        focus(fc);
-      } else {
-        // fc不存在，说明找不到一个合适的窗口，那么还是显示当前窗口，仅设置hid标识
-        c->hid = 1;
-      }
-    }
-	} else { // 当前窗口不是选中窗口
-		if (c->hid) {
-			showwin(c, 1);
-      focus(c);
-    } else {
-      hidewin(c);
-    }
-	}
-  arrange(c->mon);
+  if (sscanf(data, "cpu %llu %llu %llu %llu %llu %llu %llu %llu",
+      &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7]) < 4)
+    return;
+  for (i = 0; i < LENGTH(v); i++)
+    total += v[i];
+  idle = v[3] + v[4];
+  if (st->a && total > st->a)
+    snprintf(buf, size, "CPU %d%%",
+      (int)(100 - (idle - st->b) * 100 / (total - st->a)));
+  st->a = total;
+  st->b = idle;
 }
 
 void
-unmanage(Client *c, int destroyed)
+stmem(StatusState *st, const char *arg, char *buf, size_t size)
 {
-  Monitor *m = c->mon;
-  XWindowChanges wc;
+  char data[512], *p;
+  unsigned long long total, avail;
 
-  Client *sc;
-  if (findscratch(&sc) && sc == c) {
-    // 去除scratchtag标志位
-    selmon->tagset[selmon->seltags] &= ~scratchtag;
-    selmon->tagset[selmon->seltags ^ 1] &= ~scratchtag;
-  }
+  if (stread(st, 0, "/proc/meminfo", data, sizeof data) <= 0)
+    return;
+  if (!(p = strstr(data, "MemTotal:")) || sscanf(p, "MemTotal: %llu", &total) != 1 || !total
+  || !(p = strstr(data, "MemAvailable:")) || sscanf(p, "MemAvailable: %llu", &avail) != 1)
+    return;
+  snprintf(buf, size, "MEM %d%%", (int)((total - avail) * 100 / total));
+}
 
-  detach(c);
-  detachstack(c);
-  if (!destroyed) {
-    wc.border_width = c->oldbw;
-    XGrabServer(dpy); /* avoid race conditions */
-    XSetErrorHandler(xerrordummy);
-    XSelectInput(dpy, c->win, NoEventMask);
-    XConfigureWindow(dpy, c->win, CWBorderWidth, &wc); /* restore border */
-    XUngrabButton(dpy, AnyButton, AnyModifier, c->win);
-    setclientstate(c, WithdrawnState);
-    XSync(dpy, False);
-    XSetErrorHandler(xerror);
-    XUngrabServer(dpy);
+/* /proc/net/dev中arg接口的收发速率，接口不存在时输出为空 */
+void
+stnet(StatusState *st, const char *arg, char *buf, size_t size)
+{
+  static const char units[] = "BKMG";
+  char data[4096], name[32], *p, *nl;
+  unsigned long long rx, tx, rate[2];
+  long long now;
+  size_t len = 0, namelen;
+  off_t off = 0;
+  ssize_t n;
+  int i, u[2], found = 0;
+
+  if (st->fd[0] < 0 && (st->fd[0] = open("/proc/net/dev", O_RDONLY|O_CLOEXEC)) < 0)
+    return;
+  if ((namelen = snprintf(name, sizeof name, "%s:", arg)) >= sizeof name)
+    return;
+  /* 接口多时文件超过一个缓冲区，逐块读取并按行查找，不完整的行留到下一块 */
+  while (!found && (n = pread(st->fd[0], data + len, sizeof data - 1 - len, off)) > 0) {
+    off += n;
+    len += n;
+    data[len] = '\0';
+    for (p = data; !found && (nl = strchr(p, '\n')); p = nl + 1) {
+      *nl = '\0';
+      p += strspn(p, " ");
+      found = !strncmp(p, name, namelen)
+        && sscanf(p + namelen, "%llu %*u %*u %*u %*u %*u %*u %*u %llu", &rx, &tx) == 2;
+    }
+    len = found ? 0 : len - (p - data);
+    memmove(data, p, len);
+    if (len == sizeof data - 1)
+      len = 0; /* 一行装不下，丢弃 */
   }
-  free(c);
-  focus(NULL);
-  updateclientlist();
-  arrange(m);
+  if (!found)
+    return;
+  now = getms();
+  if (st->last && now > st->last && rx >= st->a && tx >= st->b) {
+    rate[0] = (rx - st->a) * 1000 / (now - st->last);
+    rate[1] = (tx - st->b) * 1000 / (now - st->last);
+    for (i = 0; i < 2; i++)
+      for (u[i] = 0; rate[i] >= 1024 && u[i] < 3; u[i]++)
+        rate[i] /= 1024;
+    snprintf(buf, size, "↓%llu%c ↑%llu%c", rate[0], units[u[0]], rate[1], units[u[1]]);
+  }
+  st->a = rx;
+  st->b = tx;
+}
+
+/* 第一次使用时打开并保持fd，之后每次从头pread */
+ssize_t
+stread(StatusState *st, int i, const char *path, char *buf, size_t size)
+{
+  ssize_t n;
+
+  if (st->fd[i] < 0 && (st->fd[i] = open(path, O_RDONLY|O_CLOEXEC)) < 0)
+    return -1;
+  if ((n = pread(st->fd[i], buf, size - 1, 0)) < 0)
+    return -1;
+  buf[n] = '\0';
+  return n;
 }
 
 void
-unmapnotify(XEvent *e)
+unwatchfd(int fd)
 {
-  Client *c;
-  XUnmapEvent *ev = &e->xunmap;
+  int i;
 
-  if ((c = wintoclient(ev->window))) {
-    if (ev->send_event)
-      setclientstate(c, WithdrawnState);
-    else
-      unmanage(c, 0);
-  }
-  else if ((c = wintosystrayicon(ev->window))) {
-    /* KLUDGE! sometimes icons occasionally unmap their windows, but do
-     * _not_ destroy them. We map those windows back */
-    XMapRaised(dpy, c->win);
-    updatesystray();
-  }
+  for (i = 0; i < nwatchfds; i++)
+    if (watchfds[i].fd == fd) {
+      watchfds[i].fd = -1;
+      watchfuncs[i] = NULL;
+    }
 }
 
 void
@@ -3151,7 +5930,42 @@ updatebars(void)
       XMapRaised(dpy, systray->win);
     XMapRaised(dpy, m->barwin);
     XSetClassHint(dpy, m->barwin, &ch);
+    wintabput(m->barwin, WinBar, m);
+  }
+}
+
+void
+updateclass(Client *c)
+{
+  XClassHint ch = { NULL, NULL };
+#ifdef XCB
+  xcb_get_property_reply_t *r;
+  char buf[512];
+  int n;
+
+  if (prefetched(c->win, XA_WM_CLASS, &r)) {
+    /* WM_CLASS是以0分隔的instance和class */
+    if (r && r->format == 8 && (n = MIN(r->value_len, sizeof buf - 2))) {
+      memcpy(buf, xcb_get_property_value(r), n);
+      buf[n] = buf[n + 1] = '\0';
+      ch.res_name = buf;
+      ch.res_class = buf + strlen(buf) + 1;
+    }
+    c->class    = intern(ch.res_class ? ch.res_class : broken);
+    c->instance = intern(ch.res_name  ? ch.res_name  : broken);
+    c->icon = gettagdisplayname(ch.res_class ? c->class : NULL);
+    return;
   }
+#endif
+
+  XGetClassHint(dpy, c->win, &ch);
+  c->class    = intern(ch.res_class ? ch.res_class : broken);
+  c->instance = intern(ch.res_name  ? ch.res_name  : broken);
+  c->icon = gettagdisplayname(ch.res_class ? c->class : NULL);
+  if (ch.res_class)
+    XFree(ch.res_class);
+  if (ch.res_name)
+    XFree(ch.res_name);
 }
 
 void
@@ -3256,9 +6070,108 @@ updategeom(void)
     setselmon(mons);
     setselmon(wintomon(root));
   }
+  updaterefresh();
   return dirty;
 }
 
+#ifdef XSYNC
+/* 为resizemouse创建在client的counter达到syncvalue时触发的alarm */
+void
+syncbegin(Client *c)
+{
+  XSyncAlarmAttributes aa;
+
+  if (syncevbase < 0 || c->synccounter == None)
+    return;
+  aa.trigger.counter = c->synccounter;
+  aa.trigger.value_type = XSyncAbsolute;
+  aa.trigger.test_type = XSyncPositiveComparison;
+  XSyncIntsToValue(&aa.trigger.wait_value, c->syncvalue & 0xffffffff, c->syncvalue >> 32);
+  XSyncIntToValue(&aa.delta, 0);
+  aa.events = True;
+  syncalarm = XSyncCreateAlarm(dpy, XSyncCACounter|XSyncCAValueType|XSyncCATestType
+    |XSyncCAValue|XSyncCADelta|XSyncCAEvents, &aa);
+  syncclient = c;
+  c->syncwaiting = 0;
+}
+
+/* 等待client确认上一个尺寸，超过100ms没有确认的client按不支持处理 */
+int
+syncblocked(Client *c)
+{
+  if (c != syncclient || !c->syncwaiting)
+    return 0;
+  if (getms() - c->synctime < 100)
+    return 1;
+  c->syncwaiting = 0;
+  return 0;
+}
+
+void
+syncend(void)
+{
+  if (syncalarm != None)
+    XSyncDestroyAlarm(dpy, syncalarm);
+  syncalarm = None;
+  if (syncclient)
+    syncclient->syncwaiting = 0;
+  syncclient = NULL;
+}
+
+/* 在ConfigureWindow之前发送，client重绘完新尺寸后把counter设为syncvalue */
+void
+syncrequest(Client *c)
+{
+  XSyncAlarmAttributes aa;
+
+  c->syncvalue++;
+  sendevent(c->win, wmatom[WMProtocols], NoEventMask, netatom[NetWMSyncRequest],
+    CurrentTime, c->syncvalue & 0xffffffff, c->syncvalue >> 32, 0);
+  XSyncIntsToValue(&aa.trigger.wait_value, c->syncvalue & 0xffffffff, c->syncvalue >> 32);
+  XSyncChangeAlarm(dpy, syncalarm, XSyncCAValue, &aa);
+  c->syncwaiting = 1;
+  c->synctime = getms();
+}
+
+/* 只有在WM_PROTOCOLS中声明了_NET_WM_SYNC_REQUEST的client才使用counter */
+void
+updatesynccounter(Client *c)
+{
+  Atom *protocols, type;
+  int n, format, found = 0;
+  unsigned long nitems, after;
+  unsigned char *p = NULL;
+
+  c->synccounter = None;
+  if (syncevbase < 0)
+    return;
+#ifdef XCB
+  xcb_get_property_reply_t *r;
+
+  if (prefetched(c->win, wmatom[WMProtocols], &r)) {
+    if (r && r->type == XA_ATOM && r->format == 32)
+      for (n = r->value_len; !found && n--;)
+        found = ((uint32_t *)xcb_get_property_value(r))[n] == netatom[NetWMSyncRequest];
+    if (found && prefetched(c->win, netatom[NetWMSyncRequestCounter], &r)
+    && r && r->type == XA_CARDINAL && r->format == 32 && r->value_len == 1)
+      c->synccounter = *(uint32_t *)xcb_get_property_value(r);
+    return;
+  }
+#endif
+  if (XGetWMProtocols(dpy, c->win, &protocols, &n)) {
+    while (!found && n--)
+      found = protocols[n] == netatom[NetWMSyncRequest];
+    XFree(protocols);
+  }
+  if (found && XGetWindowProperty(dpy, c->win, netatom[NetWMSyncRequestCounter], 0L, 1L, False,
+      XA_CARDINAL, &type, &format, &nitems, &after, &p) == Success && p) {
+    if (nitems == 1 && format == 32)
+      c->synccounter = *(XSyncCounter *)p;
+    XFree(p);
+  }
+}
+#endif /* XSYNC */
+
 void
 updatenumlockmask(void)
 {
@@ -3275,12 +6188,77 @@ updatenumlockmask(void)
   XFreeModifiermap(modmap);
 }
 
+/* 从XRandR取得每个monitor当前模式的刷新率，取不到时使用refreshrate */
+void
+updaterefresh(void)
+{
+  Monitor *m;
+#ifdef XRANDR
+  XRRScreenResources *res;
+  XRRCrtcInfo *crtc;
+  XRRModeInfo *mode;
+  int i, j, rate;
+#endif /* XRANDR */
+
+  for (m = mons; m; m = m->next)
+    m->refresh = 0;
+#ifdef XRANDR
+  if ((res = XRRGetScreenResourcesCurrent(dpy, root))) {
+    for (i = 0; i < res->ncrtc; i++) {
+      if (!(crtc = XRRGetCrtcInfo(dpy, res, res->crtcs[i])))
+        continue;
+      for (j = 0; j < res->nmode && crtc->mode != None; j++) {
+        mode = &res->modes[j];
+        if (mode->id != crtc->mode || !mode->hTotal || !mode->vTotal)
+          continue;
+        rate = (int)((double)mode->dotClock / ((double)mode->hTotal * mode->vTotal) + 0.5);
+        for (m = mons; m; m = m->next)
+          if (m->mx == crtc->x && m->my == crtc->y)
+            m->refresh = MAX(m->refresh, rate);
+      }
+      XRRFreeCrtcInfo(crtc);
+    }
+    XRRFreeScreenResources(res);
+  }
+#endif /* XRANDR */
+  for (m = mons; m; m = m->next)
+    if (m->refresh <= 0)
+      m->refresh = refreshrate;
+}
+
 void
 updatesizehints(Client *c)
 {
   long msize;
   XSizeHints size;
+#ifdef XCB
+  xcb_get_property_reply_t *r;
+  int32_t *v;
 
+  if (prefetched(c->win, XA_WM_NORMAL_HINTS, &r)) {
+    /* 与XGetWMNormalHints相同的解析，旧格式的15项没有base size和gravity */
+    size.flags = PSize;
+    if (r && r->type == XA_WM_SIZE_HINTS && r->format == 32 && r->value_len >= 15) {
+      v = xcb_get_property_value(r);
+      size.flags = v[0];
+      size.min_width = v[5];
+      size.min_height = v[6];
+      size.max_width = v[7];
+      size.max_height = v[8];
+      size.width_inc = v[9];
+      size.height_inc = v[10];
+      size.min_aspect.x = v[11];
+      size.min_aspect.y = v[12];
+      size.max_aspect.x = v[13];
+      size.max_aspect.y = v[14];
+      if (r->value_len >= 18) {
+        size.base_width = v[15];
+        size.base_height = v[16];
+      } else
+        size.flags &= ~(PBaseSize|PWinGravity);
+    }
+  } else
+#endif
   if (!XGetWMNormalHints(dpy, c->win, &size, &msize))
     /* size is uninitialized, ensure that size.flags aren't used */
     size.flags = PSize;
@@ -3322,10 +6300,32 @@ updatesizehints(Client *c)
 void
 updatestatus(void)
 {
-  if (!gettextprop(root, XA_WM_NAME, stext, sizeof(stext)))
-    strcpy(stext, "dwm-"VERSION);
-  drawbar(selmon);
-  updatesystray();
+  char text[sizeof stext];
+
+  if (!gettextprop(root, XA_WM_NAME, text, sizeof(text)))
+    strcpy(text, LENGTH(statusmodules) ? "" : "dwm-"VERSION);
+  setstatus(text);
+}
+
+// 重新计算各标签的展示名称：标签名加上该标签下首个客户端的名称
+void
+updatetaglabels(Monitor *m)
+{
+  unsigned int i;
+  const char *master;
+  Client *c;
+
+  if (!m || !m->pertag)
+    return;
+  for (i = 0; i < LENGTH(tags); i++) {
+    for (master = NULL, c = m->clients; c && !master; c = c->next)
+      if (c->tags & 1 << i)
+        master = c->icon;
+    if (master)
+      snprintf(m->pertag->taglabels[i], sizeof m->pertag->taglabels[i], ptagf, tags[i], master);
+    else
+      snprintf(m->pertag->taglabels[i], sizeof m->pertag->taglabels[i], etagf, tags[i]);
+  }
 }
 
 void
@@ -3407,7 +6407,6 @@ updatesystray(void)
     XSetSelectionOwner(dpy, netatom[NetSystemTray], systray->win, CurrentTime);
     if (XGetSelectionOwner(dpy, netatom[NetSystemTray]) == systray->win) {
       sendevent(root, xatom[Manager], StructureNotifyMask, CurrentTime, netatom[NetSystemTray], systray->win, 0, 0);
-      XSync(dpy, False);
     }
     else {
       fprintf(stderr, "dwm: unable to obtain system tray.\n");
@@ -3438,8 +6437,7 @@ updatesystray(void)
   XMapSubwindows(dpy, systray->win);
   /* redraw background */
   XSetForeground(dpy, drw->gc, scheme[SchemeNorm][ColBg].pixel);
-  XFillRectangle(dpy, systray->win, XCreateGC(dpy, root, 0 , NULL), 0, 0, w, bh);
-  XSync(dpy, False);
+  XFillRectangle(dpy, systray->win, drw->gc, 0, 0, w, bh);
 }
 
 void
@@ -3457,6 +6455,7 @@ updatewindowtype(Client *c)
   Atom state = getatomprop(c, netatom[NetWMState]);
   Atom wtype = getatomprop(c, netatom[NetWMWindowType]);
 
+  c->wintype = wtype;
   if (state == netatom[NetWMFullscreen])
     setfullscreen(c, 1);
   if (wtype == netatom[NetWMWindowTypeDialog])
@@ -3467,8 +6466,32 @@ void
 updatewmhints(Client *c)
 {
   XWMHints *wmh;
+#ifdef XCB
+  xcb_get_property_reply_t *r;
+  uint32_t *v;
+  XWMHints buf;
+
+  if (prefetched(c->win, XA_WM_HINTS, &r)) {
+    wmh = NULL;
+    if (r && r->type == XA_WM_HINTS && r->format == 32 && r->value_len >= 8) {
+      v = xcb_get_property_value(r);
+      buf.flags = v[0];
+      buf.input = v[1];
+      buf.initial_state = v[2];
+      buf.icon_pixmap = v[3];
+      buf.icon_window = v[4];
+      buf.icon_x = v[5];
+      buf.icon_y = v[6];
+      buf.icon_mask = v[7];
+      buf.window_group = r->value_len >= 9 ? v[8] : 0;
+      wmh = &buf;
+    }
+  } else
+#endif
+  wmh = XGetWMHints(dpy, c->win);
 
-  if ((wmh = XGetWMHints(dpy, c->win))) {
+  c->haswmh = 0;
+  if (wmh) {
     if (c == selmon->sel && wmh->flags & XUrgencyHint) {
       wmh->flags &= ~XUrgencyHint;
       XSetWMHints(dpy, c->win, wmh);
@@ -3478,6 +6501,11 @@ updatewmhints(Client *c)
       c->neverfocus = !wmh->input;
     else
       c->neverfocus = 0;
+    c->wmh = *wmh;
+    c->haswmh = 1;
+#ifdef XCB
+    if (wmh != &buf)
+#endif
     XFree(wmh);
   }
 }
@@ -3536,6 +6564,7 @@ view(const Arg *arg)
   if (ISTAG(arg->ui)) {
     return;
   }
+  REQBEGIN;
   // int prevtag = selmon->tagset[selmon->seltags];
   selmon->seltags ^= 1; /* toggle sel tagset */
   if (arg->ui & TAGMASK) {
@@ -3567,6 +6596,7 @@ view(const Arg *arg)
 
   focus(NULL);
   arrange(selmon);
+  REQEND(ReqView);
 }
 
 void
@@ -3606,7 +6636,7 @@ inwindowpids(Window w, Window pids[], int len) {
 
 int
 isdialog(Client *c) {
-  return c && getatomprop(c, netatom[NetWMWindowType]) == netatom[NetWMWindowTypeDialog];
+  return c && c->wintype == netatom[NetWMWindowTypeDialog];
 }
 
 int
@@ -3630,31 +6660,16 @@ isprevclient(int switchmode, Client *src, Client *prev) {
   }
 }
 
+// selmon和sel的变化由flushdirty中的publishstatus统一写出
 void
 setselmon(Monitor *newselmon) {
   selmon = newselmon;
-  if (newselmon != selmon) {
-    // 记录selmon状态
-    char selmonnumstr[10];
-    sprintf(selmonnumstr, "%d", newselmon->num);
-    char *cmd[] = { "dwm-status-record", selmonnumstr, "selmon", NULL };
-    Arg arg = { .v = cmd };
-    spawn(&arg);
-  }
 }
 
 void
 setmonsel(Monitor *m, Client *c) {
-  if (m) {
+  if (m)
     m->sel = c;
-    if (m == selmon && m->sel != c) {
-      char selwinnum[10];
-      sprintf(selwinnum, "%lu", c->win);
-      char *cmd[] = { "dwm-status-record", selwinnum, "selwin", NULL };
-      Arg arg = { .v = cmd };
-      spawn(&arg);
-    }
-  }
 }
 
 void
@@ -3778,43 +6793,130 @@ switchenternotify(const Arg *arg){
   }
 }
 
+#define WINTABSLOT(w, mask)     ((unsigned int)(((w) ^ ((w) >> 16)) * 0x45d9f3bU) & (mask))
+
+/* 查找w对应的表项，不存在时返回NULL */
+WinEntry *
+wintabget(Window w)
+{
+  unsigned int i, mask;
+
+  if (!wintab || !w)
+    return NULL;
+  mask = wintabsize - 1;
+  for (i = WINTABSLOT(w, mask); wintab[i].type != WinFree; i = (i + 1) & mask)
+    if (wintab[i].win == w && wintab[i].type != WinDeleted)
+      return &wintab[i];
+  return NULL;
+}
+
+void
+wintabput(Window w, int type, void *p)
+{
+  unsigned int i, mask, oldsize;
+  WinEntry *e, *old;
+
+  if (!w)
+    return;
+  if ((e = wintabget(w))) {
+    e->type = type;
+    e->p = p;
+    return;
+  }
+  /* 装载率（包含已删除的槽位）超过3/4时重建，有效表项超过一半时才扩容 */
+  if (!wintab || (wintabused + 1) * 4 > wintabsize * 3) {
+    old = wintab;
+    oldsize = wintabsize;
+    if (!wintabsize)
+      wintabsize = 256;
+    else if (wintablive * 2 >= wintabsize)
+      wintabsize *= 2;
+    wintab = ecalloc(wintabsize, sizeof(WinEntry));
+    wintabused = wintablive = 0;
+    for (i = 0; i < oldsize; i++)
+      if (old[i].type > WinDeleted)
+        wintabput(old[i].win, old[i].type, old[i].p);
+    free(old);
+  }
+  mask = wintabsize - 1;
+  for (i = WINTABSLOT(w, mask); wintab[i].type > WinDeleted; i = (i + 1) & mask);
+  if (wintab[i].type == WinFree)
+    wintabused++;
+  wintablive++;
+  wintab[i].win = w;
+  wintab[i].type = type;
+  wintab[i].p = p;
+}
+
+/* 将fd加入主循环的poll，func为NULL表示只用于唤醒（X连接） */
+int
+watchfd(int fd, short events, void (*func)(int, short))
+{
+  int i;
+
+  for (i = 0; i < nwatchfds && watchfds[i].fd >= 0; i++);
+  if (i == LENGTH(watchfds))
+    return -1;
+  if (i == nwatchfds)
+    nwatchfds++;
+  watchfds[i].fd = fd;
+  watchfds[i].events = events;
+  watchfds[i].revents = 0;
+  watchfuncs[i] = func;
+  return 0;
+}
+
+void
+watchevents(int fd, short events)
+{
+  int i;
+
+  for (i = 0; i < nwatchfds; i++)
+    if (watchfds[i].fd == fd)
+      watchfds[i].events = events;
+}
+
+void
+wintabdel(Window w)
+{
+  WinEntry *e;
+
+  if ((e = wintabget(w))) {
+    e->type = WinDeleted;
+    e->p = NULL;
+    wintablive--;
+  }
+}
+
 Client *
 wintoclient(Window w)
 {
-  Client *c;
-  Monitor *m;
+  WinEntry *e = wintabget(w);
 
-  for (m = mons; m; m = m->next)
-    for (c = m->clients; c; c = c->next)
-      if (c->win == w)
-        return c;
-  return NULL;
+  return e && e->type == WinClient ? (Client *)e->p : NULL;
 }
 
 Client *
 wintosystrayicon(Window w) {
-  Client *i = NULL;
+  WinEntry *e = wintabget(w);
 
-  if (!showsystray || !w)
-    return i;
-  for (i = systray->icons; i && i->win != w; i = i->next) ;
-  return i;
+  return e && e->type == WinSystrayIcon ? (Client *)e->p : NULL;
 }
 
 Monitor *
 wintomon(Window w)
 {
   int x, y;
-  Client *c;
-  Monitor *m;
+  WinEntry *e;
 
   if (w == root && getrootptr(&x, &y))
     return recttomon(x, y, 1, 1);
-  for (m = mons; m; m = m->next)
-    if (w == m->barwin)
-      return m;
-  if ((c = wintoclient(w)))
-    return c->mon;
+  if ((e = wintabget(w))) {
+    if (e->type == WinBar)
+      return (Monitor *)e->p;
+    if (e->type == WinClient)
+      return ((Client *)e->p)->mon;
+  }
   return selmon;
 }
 
@@ -3870,6 +6972,30 @@ systraytomon(Monitor *m) {
   return t;
 }
 
+/* 先写临时文件再rename，读取方不会看到写了一半的内容 */
+void
+writestatus(const char *name, const char *fmt, ...)
+{
+  char path[sizeof statusdir + 32], tmp[sizeof statusdir + 32], buf[512];
+  int fd, n;
+  va_list ap;
+
+  va_start(ap, fmt);
+  n = vsnprintf(buf, sizeof buf, fmt, ap);
+  va_end(ap);
+  snprintf(path, sizeof path, "%s/%s", statusdir, name);
+  snprintf(tmp, sizeof tmp, "%s/.%s.tmp", statusdir, name);
+  if ((fd = open(tmp, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0644)) < 0)
+    return;
+  if (write(fd, buf, MIN(n, (int)sizeof buf - 1)) < 0) {
+    close(fd);
+    unlink(tmp);
+    return;
+  }
+  close(fd);
+  rename(tmp, path);
+}
+
 void
 xinitvisual()
 {
@@ -3932,7 +7058,7 @@ void
 movewin(const Arg *arg)
 {
     Client *c;
-    int x, y, nx, ny;
+    int i, x, y;
     int px, py;
 
     c = selmon->sel;
@@ -3940,10 +7066,27 @@ movewin(const Arg *arg)
         return;
     if (!c->isfloating)
         togglefloating(NULL);
-    x = nx = c->x; // x, next x
-    y = ny = c->y; // y, next y
-    int gap, tctx, tcty, tx, ty;
-    switch (arg->ui) {
+    // 轮廓模式下连续按键只移动轮廓，停止outlinedelay ms后再提交
+    if (outlinebegin(c))
+        settimer(outlinedelay, outlineend, c);
+    x = c->x;
+    y = c->y;
+    // 合并的自动重复按次数逐步移动，指针只查询和移动一次
+    for (i = 0; i < keyrepeat; i++)
+        movewinstep(c, arg->ui);
+    getrootptr(&px, &py);
+    if (inarea(px, py, x, y, c->w, c->h)) {
+      XWarpPointer(dpy, None, root, 0, 0, 0, 0, c->x - x + px, c->y - y + py);
+    }
+}
+
+/* 按dir移动一步，带窗口吸附和边缘吸附 */
+void
+movewinstep(Client *c, unsigned int dir)
+{
+    int nx = c->x, ny = c->y; // next x, next y
+    int gap;
+    switch (dir) {
         case WIN_UP:
             ny -= c->mon->wh / movewinthresholdv;
             // 窗口吸附
@@ -4041,10 +7184,6 @@ movewin(const Arg *arg)
     }
 
     resize(c, nx, ny, c->w, c->h, 1);
-    getrootptr(&px, &py);
-    if (inarea(px, py, x, y, c->w, c->h)) {
-      XWarpPointer(dpy, None, root, 0, 0, 0, 0, nx - x + px, ny - y + py);
-    }
 }
 
 void
@@ -4059,20 +7198,22 @@ resizewin(const Arg *arg)
         return;
     if (!c->isfloating)
         togglefloating(NULL);
+    if (outlinebegin(c))
+        settimer(outlinedelay, outlineend, c);
     w = nw = c->w;
     h = nh = c->h;
     switch (arg->ui) {
         case H_EXPAND:
-            nw += selmon->wh / resizewinthresholdv;
+            nw += keyrepeat * (selmon->wh / resizewinthresholdv);
             break;
         case H_REDUCE:
-            nw -= selmon->wh / resizewinthresholdv;
+            nw -= keyrepeat * (selmon->wh / resizewinthresholdv);
             break;
         case V_EXPAND:
-            nh += selmon->ww / resizewinthresholdh;
+            nh += keyrepeat * (selmon->ww / resizewinthresholdh);
             break;
         case V_REDUCE:
-            nh -= selmon->ww / resizewinthresholdh;
+            nh -= keyrepeat * (selmon->ww / resizewinthresholdh);
             break;
     }
     nw = MAX(nw, selmon->ww / resizewinthresholdv);
@@ -4100,68 +7241,123 @@ mousefocus(const Arg *arg) {
   }
 }
 
+/* 按下时先移动一个基础步长，按住期间由mousetick按刷新率移动，松开时停止 */
 void
 mousemove(const Arg *arg) {
-  struct timeval tv;
-  gettimeofday(&tv, NULL);
-  long long curms = (long long) tv.tv_sec * 1000 + tv.tv_usec/ 1000;
-  if (curms - prevmousemove < 100) {
-    if (beginmousemove == 0) {
-      beginmousemove = curms;
-    }
-  } else {
-    beginmousemove = 0;
-  }
-  prevmousemove = curms;
-
-  if (arg) {
-    // v是鼠标移动的速度
-    // k是基础速度
-    // t是按压时间
-    // e是自然对数的底数，约等于2.71828
-    double base = 15;
-    double t = beginmousemove == 0 ? 0 : (curms - beginmousemove);
-    double delta = 400;
-    double deltams = 1000 * 2;
-    double v = base + delta * tanh(t / deltams);
-    int step = ceil(v);
-
-    int x, y;
-    getrootptr(&x, &y);
-    int dir = arg->ui % 4;
-    if (dir == MOUSE_UP) {
-      y -= step;
-    } else if (dir == MOUSE_RIGHT) {
-      x += step;
-    } else if (dir == MOUSE_DOWM) {
-      y += step;
-    } else {
-      x -= step;
+  unsigned int dir = arg->ui % 4;
+  long long now = getms();
+
+  if (mousedirs & 1 << dir)
+    return; // 自动重复，移动由mousetick负责
+  XWarpPointer(dpy, None, None, 0, 0, 0, 0, mousedx[dir] * 15, mousedy[dir] * 15);
+  if (!curkeycode)
+    return; // 不是由按键触发（如dwm-msg），没有KeyRelease可以等待
+  if (!mousedirs) {
+    /* 被动grab在先松开的键上就结束了，主动grab键盘直到所有方向键都松开，
+     * 每个KeyRelease都会发给dwm */
+    XGrabKeyboard(dpy, root, True, GrabModeAsync, GrabModeAsync, CurrentTime);
+    mousestart = mouselast = now;
+    mousefx = mousefy = 0;
+    settimer(1000 / selmon->refresh, mousetick, NULL);
+  }
+  mousedirs |= 1 << dir;
+  mousekeys[dir] = curkeycode;
+}
+
+/* 积分按住方向上的速度，用相对XWarpPointer移动指针，不需要查询指针位置 */
+void
+mousetick(void *arg)
+{
+  long long now = getms();
+  unsigned int i;
+  double v, dt;
+  int dx, dy;
+
+  if (!mousedirs)
+    return;
+  // 速度v(px/s)随按住时间t按tanh曲线增加，相当于原来25Hz自动重复时每次15px到415px
+  v = 25 * (15 + 400 * tanh((now - mousestart) / 2000.0));
+  dt = (now - mouselast) / 1000.0;
+  mouselast = now;
+  for (i = 0; i < LENGTH(mousekeys); i++)
+    if (mousedirs & 1 << i) {
+      mousefx += mousedx[i] * v * dt;
+      mousefy += mousedy[i] * v * dt;
     }
-    XWarpPointer(dpy, None, root, 0, 0, 0, 0, x, y);
+  dx = mousefx;
+  dy = mousefy;
+  mousefx -= dx;
+  mousefy -= dy;
+  if (dx || dy)
+    XWarpPointer(dpy, None, None, 0, 0, 0, 0, dx, dy);
+  settimer(1000 / selmon->refresh, mousetick, NULL);
+}
+
+/* 模拟点击第arg->ui个鼠标按键，X server没有XTest时使用xdotool */
+void
+mouseclick(const Arg *arg)
+{
+  char button[16];
+  const char *cmd[] = { "xdotool", "click", button, NULL };
+  Arg a = { .v = cmd };
+
+#ifdef XTEST
+  if (xtest) {
+    XTestFakeButtonEvent(dpy, arg->ui, True, CurrentTime);
+    XTestFakeButtonEvent(dpy, arg->ui, False, CurrentTime);
+    return;
   }
+#endif /* XTEST */
+  snprintf(button, sizeof button, "%u", arg->ui);
+  spawn(&a);
 }
 
 int
 main(int argc, char *argv[])
 {
+  int restored;
+
   if (argc == 2 && !strcmp("-v", argv[1]))
     die("dwm-"VERSION);
   else if (argc != 1)
     die("usage: dwm [-v]");
   if (!setlocale(LC_CTYPE, "") || !XSupportsLocale())
     fputs("warning: no locale support\n", stderr);
+  startphase(NULL);
   if (!(dpy = XOpenDisplay(NULL)))
     die("dwm: cannot open display");
   checkotherwm();
+  startphase("connect");
   setup();
 #ifdef __OpenBSD__
-  if (pledge("stdio rpath proc exec", NULL) == -1)
+  if (pledge("stdio rpath wpath cpath dpath unix proc exec", NULL) == -1)
     die("pledge");
 #endif /* __OpenBSD__ */
+  loadstate();
   scan();
-  runautosh(autostartblocksh, autostartsh);
+  /* 有_DWM_STATE说明是restart后exec的进程，autostart启动的程序还在运行 */
+  restored = restorestate != NULL;
+  if (restorestate) {
+    XFree(restorestate);
+    restorestate = restoreclients = NULL;
+    nrestoreclients = 0;
+  }
+  startphase("scan");
+  startreport();
+  if (!restored)
+    runautosh(autostartblocksh, autostartsh);
   run();
+  if (restarting) {
+    /* 不unmanage，窗口保持原来的状态和位置，断开连接后exec新的二进制 */
+    if (session)
+      savesession(NULL);
+    savestate();
+    cleanupipc();
+    cleanupstatusmodules();
+    XCloseDisplay(dpy);
+    execvp(argv[0], argv);
+    die("dwm: execvp '%s' failed:", argv[0]);
+  }
   cleanup();
   XCloseDisplay(dpy);
   runautosh(autostopblocksh, autostopsh);
@@ -0,0 +1,49 @@
+/* See LICENSE file for copyright and license details. */
+
+/* Counts the Xlib calls that wait for a reply from the server (round
+ * trips) and the explicit flushes, for dwm-msg stats. Include after the
+ * Xlib and xcb headers. Without STATS this header defines nothing. */
+#ifdef STATS
+extern unsigned long xroundtrips, xflushes;
+
+#define XROUNDTRIP(call)         (xroundtrips++, call)
+#define XSync(...)               XROUNDTRIP(XSync(__VA_ARGS__))
+#define XFlush(...)              (xflushes++, XFlush(__VA_ARGS__))
+#define XInternAtom(...)         XROUNDTRIP(XInternAtom(__VA_ARGS__))
+#define XInternAtoms(...)        XROUNDTRIP(XInternAtoms(__VA_ARGS__))
+#define XGetWindowProperty(...)  XROUNDTRIP(XGetWindowProperty(__VA_ARGS__))
+#define XGetWindowAttributes(...) XROUNDTRIP(XGetWindowAttributes(__VA_ARGS__))
+#define XGetTransientForHint(...) XROUNDTRIP(XGetTransientForHint(__VA_ARGS__))
+#define XGetWMProtocols(...)     XROUNDTRIP(XGetWMProtocols(__VA_ARGS__))
+#define XGetWMNormalHints(...)   XROUNDTRIP(XGetWMNormalHints(__VA_ARGS__))
+#define XGetWMHints(...)         XROUNDTRIP(XGetWMHints(__VA_ARGS__))
+#define XGetTextProperty(...)    XROUNDTRIP(XGetTextProperty(__VA_ARGS__))
+#define XGetClassHint(...)       XROUNDTRIP(XGetClassHint(__VA_ARGS__))
+#define XGetSelectionOwner(...)  XROUNDTRIP(XGetSelectionOwner(__VA_ARGS__))
+#define XGetModifierMapping(...) XROUNDTRIP(XGetModifierMapping(__VA_ARGS__))
+#define XQueryTree(...)          XROUNDTRIP(XQueryTree(__VA_ARGS__))
+#define XQueryPointer(...)       XROUNDTRIP(XQueryPointer(__VA_ARGS__))
+#define XGrabKeyboard(...)       XROUNDTRIP(XGrabKeyboard(__VA_ARGS__))
+#define XkbSetDetectableAutoRepeat(...) XROUNDTRIP(XkbSetDetectableAutoRepeat(__VA_ARGS__))
+#define XineramaIsActive(...)    XROUNDTRIP(XineramaIsActive(__VA_ARGS__))
+#define XineramaQueryScreens(...) XROUNDTRIP(XineramaQueryScreens(__VA_ARGS__))
+#define XRRGetScreenResourcesCurrent(...) XROUNDTRIP(XRRGetScreenResourcesCurrent(__VA_ARGS__))
+#define XRRGetCrtcInfo(...)      XROUNDTRIP(XRRGetCrtcInfo(__VA_ARGS__))
+#define XSyncQueryExtension(...) XROUNDTRIP(XSyncQueryExtension(__VA_ARGS__))
+#define XSyncInitialize(...)     XROUNDTRIP(XSyncInitialize(__VA_ARGS__))
+#define XTestQueryExtension(...) XROUNDTRIP(XTestQueryExtension(__VA_ARGS__))
+/* Xlib fetches the keyboard mapping (GetKeyboardMapping) on the first
+ * keysym lookup and again after each XRefreshKeyboardMapping. */
+extern int xkeymapstale;
+#define XKEYMAP(call)            ((xkeymapstale ? (xkeymapstale = 0, xroundtrips++) : 0), call)
+#define XRefreshKeyboardMapping(...) (xkeymapstale = 1, XRefreshKeyboardMapping(__VA_ARGS__))
+#define XKeysymToKeycode(...)    XKEYMAP(XKeysymToKeycode(__VA_ARGS__))
+#define XKeycodeToKeysym(...)    XKEYMAP(XKeycodeToKeysym(__VA_ARGS__))
+/* Each xcb_*_reply may block until the server answers. Replies to
+ * pipelined requests are often already buffered, so these counts are an
+ * upper bound. */
+#define xcb_get_property_reply(...)          XROUNDTRIP(xcb_get_property_reply(__VA_ARGS__))
+#define xcb_get_window_attributes_reply(...) XROUNDTRIP(xcb_get_window_attributes_reply(__VA_ARGS__))
+#define xcb_get_geometry_reply(...)          XROUNDTRIP(xcb_get_geometry_reply(__VA_ARGS__))
+#define XGrabPointer(...)        XROUNDTRIP(XGrabPointer(__VA_ARGS__))
+#endif